@@ -0,0 +1,194 @@
+#pragma once
+
+#include "deep_holes.h"
+#include "dot_gradient_descent.h"
+#include "file_output.h"
+#include "initial_states.h"
+#include "thread_pool.h"
+#include <cmath>
+#include <random>
+
+// Basin hopping around a near miss. Every round makes a batch of perturbed copies of the current
+// configuration, re-descends each with a short budget on its own thread, and moves to the best
+// copy by the Metropolis rule on score. The perturbations are structured rather than uniform:
+//   noise     - AddNoise over every ball
+//   relocate  - the ball with the most overlap moves to the deepest hole of the rest
+//   rotate    - a random cap of balls turns rigidly in a random plane
+// so one round explores a shake, a repair and a local rearrangement side by side.
+struct BasinHoppingParams
+{
+    size_t mThreads = 1;
+    size_t mRounds = 20;
+    // Perturbed copies per round, shared out across the threads
+    size_t mCopies = 12;
+    // Outer epochs for the first descent and for each copy's re-descent
+    size_t mStartEpochs = 20 * 1000;
+    size_t mHopEpochs = 2000;
+    // Only start from configurations at least this close - further ones are not near misses
+    double mMaxStartScore = 1;
+    // Metropolis temperature, in score
+    double mTemperature = 0.02;
+    double mNoise = 0.03;
+    // Cap half angle in radians, and the spread of its rotation angle
+    double mCapAngle = 1.0;
+    double mRotation = 0.15;
+};
+
+enum class Perturbation
+{
+    Noise,
+    Relocate,
+    Rotate,
+};
+
+// Overlap each ball takes part in
+template <size_t Dim>
+std::vector<double> BallOverlaps(std::vector<Vector<Dim>> const & state, NeighboursLookup const & neighbourLookup)
+{
+    std::vector<double> ret(state.size());
+    for (PointId pointId = 0; pointId < state.size(); pointId++)
+    {
+        for (PointId neighbourId : neighbourLookup[pointId])
+        {
+            auto overlap = Dot(state[pointId], state[neighbourId]) / ScaledOneSquared - 0.5;
+            if (overlap > 0)
+            {
+                ret[pointId] += overlap;
+                ret[neighbourId] += overlap;
+            }
+        }
+    }
+
+    return ret;
+}
+
+template <size_t Dim, typename Rand>
+void RelocateWorstBall(std::vector<Vector<Dim>> & state, Rand & rand)
+{
+    auto overlaps = BallOverlaps(state, ConstructPointNeighbours(state));
+    auto worst = std::max_element(overlaps.begin(), overlaps.end()) - overlaps.begin();
+
+    std::swap(state[worst], state.back());
+    state.pop_back();
+    auto holes = FindDeepHoles(state, rand, 1);
+    state.push_back(holes.front().mCentre);
+    Normalize(state.back(), ScaledOne);
+}
+
+template <size_t Dim, typename Rand>
+void RotateCap(std::vector<Vector<Dim>> & state, Rand & rand, double capAngle, double rotation)
+{
+    std::uniform_int_distribution<size_t> ballDistn(0, state.size() - 1);
+    std::normal_distribution<double> gaussian;
+    auto centre = state[ballDistn(rand)];
+    auto capDot = std::cos(capAngle) * ScaledOneSquared;
+
+    // Orthonormal u, v spanning the plane of rotation
+    auto u = RandPointOnSphere<Dim>(1, rand);
+    auto v = RandPointOnSphere<Dim>(1, rand);
+    SubMult(v, u, Dot(u, v));
+    Normalize(v, 1);
+
+    auto angle = DrawGaussian(rand, gaussian) * rotation;
+    auto cosAngle = std::cos(angle);
+    auto sinAngle = std::sin(angle);
+
+    for (auto & point : state)
+    {
+        if (Dot(point, centre) < capDot)
+        {
+            continue;
+        }
+
+        auto pu = Dot(point, u);
+        auto pv = Dot(point, v);
+        SubMult(point, u, (1 - cosAngle) * pu + sinAngle * pv);
+        SubMult(point, v, (1 - cosAngle) * pv - sinAngle * pu);
+    }
+}
+
+template <size_t Dim, typename Rand>
+void Perturb(std::vector<Vector<Dim>> & state, Perturbation kind, Rand & rand, BasinHoppingParams const & params)
+{
+    switch (kind)
+    {
+        case Perturbation::Noise:
+            AddNoise(rand, state, params.mNoise * ScaledOne);
+            return;
+        case Perturbation::Relocate:
+            RelocateWorstBall(state, rand);
+            return;
+        case Perturbation::Rotate:
+            RotateCap(state, rand, params.mCapAngle, params.mRotation);
+            return;
+    }
+}
+
+// Returns the final score and the hop rounds run. state ends as the best configuration seen.
+template <size_t Dim, typename Rand, typename OutputT, typename LossFunc>
+EngineResult RunBasinHopping(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & frameOutput, BasinHoppingParams const & params,
+    LossFunc lossFunc, StagnationParams const & stagnation, PolishParams const & polish)
+{
+    auto start = RunGradientDescent(state, frameOutput, params.mStartEpochs, nullptr, lossFunc, stagnation, polish);
+    if (start.mScore == 0 || start.mScore > params.mMaxStartScore)
+    {
+        return EngineResult{start.mScore, 0, start.mTermination};
+    }
+
+    struct Copy
+    {
+        std::vector<Vector<Dim>> mState;
+        double mScore;
+    };
+
+    auto current = state;
+    auto currentScore = start.mScore;
+    auto bestScore = start.mScore;
+    std::vector<Copy> copies(params.mCopies);
+    std::vector<Rand> copyRands;
+
+    ThreadPool pool(std::min(params.mThreads, params.mCopies));
+    std::uniform_real_distribution<double> realDistn(0, 1);
+
+    for (size_t round = 0; round < params.mRounds; round++)
+    {
+        // Split on this thread - only Philox can split without touching the parent
+        copyRands.clear();
+        for (size_t copyIdx = 0; copyIdx < copies.size(); copyIdx++)
+        {
+            copyRands.push_back(SplitStream(rand, round * copies.size() + copyIdx + 1));
+        }
+
+        auto task = [&](size_t threadIdx) {
+            NoOutput noOutput;
+            for (size_t copyIdx = threadIdx; copyIdx < copies.size(); copyIdx += pool.Size())
+            {
+                auto & copy = copies[copyIdx];
+                copy.mState = current;
+                Perturb(copy.mState, static_cast<Perturbation>(copyIdx % 3), copyRands[copyIdx], params);
+                copy.mScore = RunGradientDescent(copy.mState, noOutput, params.mHopEpochs, nullptr, lossFunc, stagnation, polish).mScore;
+            }
+        };
+        pool.RunOnAll(task);
+
+        auto & best = *std::min_element(copies.begin(), copies.end(), [](auto const & a, auto const & b) { return a.mScore < b.mScore; });
+        if (best.mScore < bestScore)
+        {
+            bestScore = best.mScore;
+            state = best.mState;
+        }
+        if (best.mScore <= currentScore || DrawUniform(rand, realDistn) < std::exp((currentScore - best.mScore) / params.mTemperature))
+        {
+            current = std::move(best.mState);
+            currentScore = best.mScore;
+        }
+        frameOutput.WriteRow(current);
+
+        if (bestScore == 0)
+        {
+            return EngineResult{0, round + 1, Termination::Converged};
+        }
+    }
+
+    return EngineResult{bestScore, params.mRounds, Termination::Budget};
+}
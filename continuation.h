@@ -0,0 +1,82 @@
+#pragma once
+
+#include "dot_diffs.h"
+#include "progress_tracker.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// Continuation for the descent: start soft and wide, tighten to the fixed setup as the
+// configuration gets close. Early on pairs push from further below contact, with larger steps
+// and a flatter loss, so crowded regions spread out quickly instead of inching apart on the
+// sharpest overlaps. Progress through the schedule is driven by the worst overlap the tracker
+// measures (log-linear between mStartViolation and mEndViolation), and a stall at any stage moves
+// it on a notch, so a schedule never holds a run at settings it cannot finish under.
+struct ContinuationParams
+{
+    // Worst overlap the schedule starts tightening below, 0 runs the fixed setup throughout
+    double mStartViolation = 0;
+    // Worst overlap the fixed setup is reached at
+    double mEndViolation = 1e-4;
+    // Softest settings - mSharpness scales the loss's spread above 1, 1 is the loss itself
+    PairStep mStartStep{4 * DELTA, 25};
+    double mStartSharpness = 0.25;
+    // Epochs without the worst overlap improving before tightening regardless, and by how much
+    size_t mStallEpochs = 500;
+    double mStallAdvance = 0.25;
+};
+
+// Loss policy wrapping another with the schedule's current step and sharpness. RunLoops hands it
+// each measured violation through Update.
+template <typename Inner>
+struct ContinuationLoss
+{
+    Inner mInner;
+    ContinuationParams mParams;
+    // The fixed setup it ends on, at the run's contact angle
+    PairStep mEnd;
+    PairStep mStep = mParams.mStartStep;
+    double mSharpness = mParams.mStartSharpness;
+    // 0 softest to 1 the fixed setup, only ever moves forward
+    double mProgress = 0;
+    double mBestMax = std::numeric_limits<double>::infinity();
+    size_t mLastImprovement = 0;
+
+    double operator()(double cos_theta) const
+    {
+        return 1 + mSharpness * (mInner(cos_theta) - 1);
+    }
+
+    void Update(size_t epoch, Violation const & violation)
+    {
+        auto measured = 1.0;
+        if (violation.mMax > 0)
+        {
+            measured = std::log(mParams.mStartViolation / violation.mMax) / std::log(mParams.mStartViolation / mParams.mEndViolation);
+        }
+        mProgress = std::clamp(std::max(mProgress, measured), 0.0, 1.0);
+
+        if (violation.mMax < mBestMax)
+        {
+            mBestMax = violation.mMax;
+            mLastImprovement = epoch;
+        }
+        else if (epoch - mLastImprovement >= mParams.mStallEpochs)
+        {
+            mProgress = std::min(1.0, mProgress + mParams.mStallAdvance);
+            mLastImprovement = epoch;
+        }
+
+        // Geometric between the start settings and the fixed ones, which it ends on exactly
+        if (mProgress == 1)
+        {
+            mStep = mEnd;
+            mSharpness = 1;
+            return;
+        }
+        auto towards = [&](double start, double end) { return start * std::pow(end / start, mProgress); };
+        mStep.mDelta = towards(mParams.mStartStep.mDelta, mEnd.mDelta);
+        mStep.mRampIn = towards(mParams.mStartStep.mRampIn, mEnd.mRampIn);
+        mSharpness = towards(mParams.mStartSharpness, 1);
+    }
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "fast_math.h"
+#include "kernel_dispatch.h"
+#include "philox.h"
+#include "vectors.h"
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+// Deep holes of a configuration on the sphere: the directions whose nearest point is as far
+// away as possible, i.e. the vertices of the spherical Voronoi diagram with the largest radius.
+// Rather than build the diagram, random directions climb to a local vertex by minimising a
+// soft maximum of their dot products with the points, sharpened as they go. Each climb is
+// O(points x Dim) per step, so a few hundred climbs stay cheap next to a descent.
+template <size_t Dim>
+struct Hole
+{
+    Vector<Dim> mCentre;
+    // cos of the angle to the nearest point - smaller is deeper
+    double mMaxDot;
+};
+
+struct HoleSearchParams
+{
+    // Random starts per point in the configuration, and at least
+    size_t mStartsPerPoint = 2;
+    size_t mMinStarts = 64;
+    size_t mSteps = 80;
+    // Soft maximum sharpness at the first and last step
+    double mStartSharpness = 20;
+    double mEndSharpness = 4000;
+    // Step length along the sphere at the first and last step, in radians
+    double mStartStep = 0.2;
+    double mEndStep = 1e-4;
+    // Climbs ending closer than this (cos of the angle) are the same hole
+    double mSameHoleDot = 0.9999;
+};
+
+template <size_t Dim>
+double MaxDot(std::vector<Vector<Dim>> const & points, Vector<Dim> const & direction)
+{
+    double ret = -1;
+    for (auto const & point : points)
+    {
+        ret = std::max(ret, Dot(point, direction));
+    }
+    return ret;
+}
+
+// Climbs unit direction to a local deep hole of points (unit vectors) in place
+template <size_t Dim>
+KISSING_KERNEL void ClimbToHole(std::vector<Vector<Dim>> const & points, Vector<Dim> & direction, HoleSearchParams const & params, std::vector<double> & weights)
+{
+    weights.resize(points.size());
+    auto sharpnessGrowth = std::pow(params.mEndSharpness / params.mStartSharpness, 1.0 / params.mSteps);
+    auto stepDecay = std::pow(params.mEndStep / params.mStartStep, 1.0 / params.mSteps);
+    auto sharpness = params.mStartSharpness;
+    auto step = params.mStartStep;
+
+    for (size_t iteration = 0; iteration < params.mSteps; iteration++)
+    {
+        double maxDot = -1;
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            weights[i] = Dot(points[i], direction);
+            maxDot = std::max(maxDot, weights[i]);
+        }
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            // Far points weigh nothing next to the nearest's 1, so the exponent is cut off where
+            // FastExp still holds
+            weights[i] = FastExp(std::max(-700.0, sharpness * (weights[i] - maxDot)));
+        }
+
+        // Gradient of the soft maximum, then its part along the sphere
+        Vector<Dim> push;
+        push.Zero();
+        double totalWeight = 0;
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            SubMult(push, points[i], -weights[i]);
+            totalWeight += weights[i];
+        }
+        SubMult(push, direction, Dot(push, direction));
+
+        auto pushNorm = std::sqrt(Dot(push, push));
+        if (pushNorm * totalWeight == 0)
+        {
+            return;
+        }
+        SubMult(direction, push, step / pushNorm);
+        Normalize(direction, 1);
+
+        sharpness *= sharpnessGrowth;
+        step *= stepDecay;
+    }
+}
+
+// Up to maxHoles distinct deep holes of points, deepest first
+template <size_t Dim, typename Rand>
+std::vector<Hole<Dim>> FindDeepHoles(std::vector<Vector<Dim>> const & points, Rand & rand, size_t maxHoles, HoleSearchParams const & params = {})
+{
+    std::vector<Vector<Dim>> unitPoints(points);
+    Normalize(unitPoints, 1);
+
+    std::normal_distribution<double> gaussian;
+    std::vector<double> weights;
+    std::vector<Hole<Dim>> climbs;
+    auto nStarts = std::max(params.mMinStarts, params.mStartsPerPoint * points.size());
+    for (size_t start = 0; start < nStarts; start++)
+    {
+        Vector<Dim> direction;
+        for (auto & coord : direction.mValues)
+        {
+            coord = DrawGaussian(rand, gaussian);
+        }
+        Normalize(direction, 1);
+
+        ClimbToHole(unitPoints, direction, params, weights);
+        climbs.push_back(Hole<Dim>{direction, MaxDot(unitPoints, direction)});
+    }
+
+    // Sorts indices - std::sort's heap passes elements by value, and a 32 byte aligned Hole<4>
+    // by value draws a -Wpsabi note
+    std::vector<size_t> deepest(climbs.size());
+    std::iota(deepest.begin(), deepest.end(), 0);
+    std::sort(deepest.begin(), deepest.end(), [&](size_t a, size_t b) { return climbs[a].mMaxDot < climbs[b].mMaxDot; });
+
+    std::vector<Hole<Dim>> ret;
+    for (auto climbIdx : deepest)
+    {
+        auto const & climb = climbs[climbIdx];
+        auto sameHole = [&](Hole<Dim> const & hole) { return Dot(hole.mCentre, climb.mCentre) > params.mSameHoleDot; };
+        if (std::none_of(ret.begin(), ret.end(), sameHole))
+        {
+            ret.push_back(climb);
+            if (ret.size() == maxHoles)
+            {
+                break;
+            }
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "debug_output.h"
+#include "dot_diffs.h"
+#include "loss_functions.h"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// The gradient descent's constants as runtime settings, so tune can fit them per dimension and
+// ball count. The defaults are the values hand tuned for 4D.
+struct DescentParams
+{
+    double mDelta = DELTA;
+    double mRampIn = RAMP_IN;
+    double mQuadDelta = QUAD_DELTA;
+    double mNeighbourMargin = NeighbourMargin;
+    double mLossClamp = LossClamp;
+    // Pair push rounds per neighbour list rebuild, and outer epochs when no budget is given
+    size_t mInnerLoops = 100;
+    size_t mOuterEpochs = 20 * 1000;
+
+    PairStep Step(double contact) const
+    {
+        return PairStep{mDelta, mRampIn, contact, mQuadDelta, mNeighbourMargin};
+    }
+
+    bool operator==(DescentParams const &) const = default;
+};
+
+// Calls func(name, field) for each setting, in config file order
+template <typename Params, typename Func>
+void ForEachDescentField(Params & params, Func && func)
+{
+    func("delta", params.mDelta);
+    func("ramp_in", params.mRampIn);
+    func("quad_delta", params.mQuadDelta);
+    func("neighbour_margin", params.mNeighbourMargin);
+    func("loss_clamp", params.mLossClamp);
+    func("inner_loops", params.mInnerLoops);
+    func("outer_epochs", params.mOuterEpochs);
+}
+
+// Descent config files are "name value" lines with # comments, headed by the dim and balls they
+// were tuned for:
+//   dim 4
+//   balls 24
+//   delta 1e-05
+//   ...
+// Settings left out keep their defaults.
+inline void WriteDescentParams(std::filesystem::path const & path, DescentParams const & params, size_t dim, size_t nBalls, std::string const & comment)
+{
+    std::ofstream out(path);
+    out.precision(17);
+    out << "# " << comment << "\n";
+    out << "dim " << dim << "\n";
+    out << "balls " << nBalls << "\n";
+    ForEachDescentField(params, [&](char const * name, auto const & value) { out << name << " " << value << "\n"; });
+    out.flush();
+    ASSERT_MSG(out, "could not write {}", path.string());
+}
+
+inline DescentParams ReadDescentParams(std::filesystem::path const & path, size_t dim, size_t nBalls)
+{
+    std::ifstream in(path);
+    ASSERT_MSG(in, "could not open descent config {}", path.string());
+
+    DescentParams ret;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name))
+        {
+            continue;
+        }
+
+        bool known = false;
+        if (name == "dim" || name == "balls")
+        {
+            size_t value = 0;
+            fields >> value;
+            ASSERT_MSG(value == (name == "dim" ? dim : nBalls), "{} was tuned for another {}", path.string(), name);
+            known = true;
+        }
+        ForEachDescentField(ret, [&](char const * field, auto & value) {
+            if (name == field)
+            {
+                fields >> value;
+                known = true;
+            }
+        });
+        ASSERT_MSG(known && fields, "bad line in {}: {}", path.string(), line);
+    }
+
+    return ret;
+}
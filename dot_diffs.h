@@ -0,0 +1,200 @@
+#pragma once
+
+#include "neighbours.h"
+#include "weight_boosting.h"
+#include <span>
+
+static constexpr double DELTA = 1e-5;
+static constexpr double QUAD_DELTA = 1;
+static constexpr PointType RAMP_IN = 5;
+
+// Largest push of a pair, the ramp its push grows over below contact, and the cos theta of
+// contact itself - 0.5 for kissing, others for spherical codes. Pairs start pushing
+// mDelta * mRampIn below contact. mQuadDelta scales the radial force holding points on the sphere
+// and mNeighbourMargin is the squared distance neighbour lists are built to at contact 0.5.
+struct PairStep
+{
+    double mDelta = DELTA;
+    double mRampIn = RAMP_IN;
+    double mContact = 0.5;
+    double mQuadDelta = QUAD_DELTA;
+    double mNeighbourMargin = NeighbourMargin;
+
+    bool operator==(PairStep const &) const = default;
+
+    double Threshold() const
+    {
+        // Give it this tiny bit of ramp in to try to help stability
+        return mContact - (mDelta * mRampIn);
+    }
+};
+
+// Loss policies may carry their own step (see continuation.h), the rest use the fixed one
+template <typename LossFunc>
+PairStep StepOf(LossFunc const & lossFunc)
+{
+    if constexpr (requires { lossFunc.mStep; })
+    {
+        return lossFunc.mStep;
+    }
+    else
+    {
+        return PairStep{};
+    }
+}
+
+// A loss policy run with a step of its own, e.g. another contact angle
+template <typename Inner>
+struct SteppedLoss
+{
+    Inner mInner;
+    PairStep mStep;
+
+    double operator()(double cos_theta) const
+    {
+        return mInner(cos_theta);
+    }
+};
+
+// Pairs a point's neighbour list is processed in. The first pass over a block computes every cos
+// theta and compacts the pairs over threshold without branching, the second weighs the compacted
+// pairs in one vectorisable loop and the third applies their pushes.
+static constexpr size_t PairBlock = 64;
+
+// Pushes pointId apart from each of its (higher id) neighbours, accumulating into rets.
+// Returns the largest loss weight seen, at least maxForce. Takes spans so fixed size
+// configurations (fixed_config.h) run the same arithmetic as vectors.
+//
+// Each push is along the neighbour orthogonalised against the point and normalised,
+// u = (q - c p) / |q - c p|. Orthogonalising does seem to help avoid degeneracy. The norm comes in
+// closed form from the dot product already taken for cos theta, |q - c p|^2 = |q|^2 - 2 c p.q +
+// c^2 |p|^2, so a pair costs two square roots and no per-coordinate divisions or copies.
+// Agrees with orthogonalising and calling Normalize to within 1e-13 of the largest component.
+template <size_t Dim, typename Neighbours, typename LossFunc>
+KISSING_KERNEL double AccumulatePairDiffs(std::span<Vector<Dim> const> points, std::span<PointType const> mags, std::span<PointType const> invMags, Neighbours const & pointNeighbours, PointId pointId, std::span<Vector<Dim>> rets, LossFunc & lossFunc, double maxForce)
+{
+    auto const step = StepOf(lossFunc);
+    auto const thresh = step.Threshold();
+
+    auto const & point = points[pointId];
+    auto magSq = mags[pointId] * mags[pointId];
+    auto invMag = invMags[pointId];
+    auto & ret = rets[pointId];
+
+    std::array<double, PairBlock> dots;
+    std::array<double, PairBlock> cosThetas;
+    std::array<double, PairBlock> weights;
+    std::array<uint32_t, PairBlock> active;
+
+    for (size_t blockStart = 0; blockStart < pointNeighbours.size(); blockStart += PairBlock)
+    {
+        auto blockSize = std::min(PairBlock, pointNeighbours.size() - blockStart);
+        auto const * blockNeighbours = pointNeighbours.data() + blockStart;
+
+        size_t nActive = 0;
+        double maxCos = -1;
+        for (size_t k = 0; k < blockSize; k++)
+        {
+            auto neighbourId = blockNeighbours[k];
+            auto dot = Dot(point, points[neighbourId]);
+            auto cos_theta = dot * invMag * invMags[neighbourId];
+            // std::max would drop a NaN; keep it so the check below catches it
+            maxCos = cos_theta > maxCos || cos_theta != cos_theta ? cos_theta : maxCos;
+
+            // Always write, only advance over the threshold
+            active[nActive] = static_cast<uint32_t>(k);
+            dots[nActive] = dot;
+            cosThetas[nActive] = cos_theta;
+            nActive += cos_theta > thresh;
+        }
+
+        ASSERT_MSG(maxCos <= 1.0000000001, "Cos theta was {}", maxCos);
+
+        for (size_t activeIdx = 0; activeIdx < nActive; activeIdx++)
+        {
+            weights[activeIdx] = lossFunc(cosThetas[activeIdx]);
+        }
+
+        for (size_t activeIdx = 0; activeIdx < nActive; activeIdx++)
+        {
+            auto neighbourId = blockNeighbours[active[activeIdx]];
+            auto & neighbour = points[neighbourId];
+            auto cos_theta = cosThetas[activeIdx];
+            auto dot = dots[activeIdx];
+
+            double sf = weights[activeIdx];
+            maxForce = std::max(sf, maxForce);
+            auto scale = std::min(step.mDelta, (cos_theta - thresh) / step.mRampIn) * sf;
+
+            // Squared norms of q - c p and p - c q. The max only matters for coincident points.
+            auto neighbourMagSq = mags[neighbourId] * mags[neighbourId];
+            auto cosSq = cos_theta * cos_theta;
+            auto shared = -2 * cos_theta * dot;
+            auto pointTangentSq = std::max(neighbourMagSq + shared + cosSq * magSq, 1e-300);
+            auto neighbourTangentSq = std::max(magSq + shared + cosSq * neighbourMagSq, 1e-300);
+            auto pointStep = scale * ScaledOne / std::sqrt(pointTangentSq);
+            auto neighbourStep = scale * ScaledOne / std::sqrt(neighbourTangentSq);
+
+            // ret_p -= step (q - c p) and ret_q -= step (p - c q), fused into one pass
+            auto & neighbourRet = rets[neighbourId];
+            for (size_t j = 0; j < Dim; j++)
+            {
+                auto p = point.mValues[j];
+                auto q = neighbour.mValues[j];
+                ret.mValues[j] += pointStep * (cos_theta * p - q);
+                neighbourRet.mValues[j] += neighbourStep * (cos_theta * q - p);
+            }
+        }
+    }
+
+    return maxForce;
+}
+
+// Scales the summed pair pushes by the largest loss weight and adds the radial force
+template <size_t Dim>
+void FinishDiff(Vector<Dim> const & point, PointType mag, double maxForce, Vector<Dim> & ret, double quadDelta = QUAD_DELTA)
+{
+    // Apply force to keep kissing dist - quadratic unlike the linear forces for pushing away
+
+    auto magError = (mag - ScaledOne);
+    auto forceScale = std::min(magError * magError, ScaledOne);
+    auto force = std::signbit(magError) ? forceScale * quadDelta : -forceScale * quadDelta;
+
+    for (size_t j = 0; j < Dim; j++)
+    {
+        ret.mValues[j] /= maxForce;
+        ret.mValues[j] += force * point.mValues[j] / mag;
+    }
+}
+
+// Returns the largest squared step, which the descent uses to spot convergence
+template <size_t Dim, typename LossFunc>
+double CalcDotDiffs(std::vector<Vector<Dim>> const & points, NeighboursLookup const & neighbours, std::vector<Vector<Dim>> & rets, LossFunc lossFunc)
+{
+    std::vector<PointType> mags(points.size());
+    std::vector<PointType> invMags(points.size());
+
+    double maxForce = 0.1;
+
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        mags[i] = std::sqrt(Dot(points[i], points[i]));
+        invMags[i] = 1 / mags[i];
+        rets[i].Zero();
+    }
+    for (PointId pointId = 0; pointId < points.size(); pointId++)
+    {
+        maxForce = AccumulatePairDiffs<Dim>(points, mags, invMags, neighbours[pointId], pointId, rets, lossFunc, maxForce);
+        // boost[pointId].EndLoop();
+    }
+
+    auto const quadDelta = StepOf(lossFunc).mQuadDelta;
+    double maxStepSq = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        FinishDiff(points[i], mags[i], maxForce, rets[i], quadDelta);
+        maxStepSq = std::max(maxStepSq, Dot(rets[i], rets[i]));
+    }
+
+    return maxStepSq;
+}
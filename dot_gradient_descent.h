@@ -1,206 +1,218 @@
 #pragma once
 
-#include "weight_boosting.h"
+#include "dot_diffs.h"
+#include "fixed_config.h"
+#include "parallel_descent.h"
+#include "reordering.h"
+#include "continuation.h"
+#include "descent_params.h"
+#include "engine_result.h"
+#include "file_output.h"
+#include "loss_functions.h"
+#include "polish.h"
+#include "progress_tracker.h"
+#include "rigidity.h"
+#include <limits>
+#include <optional>
 
 template <size_t Dim>
-void ApplyDiff(Vector<Dim> const & point, Vector<Dim> const & neighbour, double cos_theta, double scale, Vector<Dim> & ret)
+double CalcScore(std::vector<Vector<Dim>> const & state, NeighboursLookup const & neighbourLookup, double contact = 0.5)
 {
-    // SubMult(ret, neighbour, scale);
+    return CalcViolation(state, neighbourLookup, contact).mScore;
+}
 
-    // Lets just assume mags are close enough to 1...
-    auto neighbourCopy = neighbour;
+// Largest squared step of a descent that has stopped moving
+static constexpr double ConvergedStepSq = 1e-18;
 
-    // Orthoganlize the vector before scaling
-    // This does seem to help avoid degeneracy. Unclear if it helps much in non degenerate cases.
-    SubMult(neighbourCopy, point, cos_theta);
-    Normalize(neighbourCopy, ScaledOne);
-    SubMult(ret, neighbourCopy, scale);
-}
+struct LoopsResult
+{
+    size_t mEpochs;
+    Termination mTermination;
+};
 
+// InnerIterationLoops rounds of CalcDotDiffs, each added into the state. Returns the largest
+// squared step of the last round.
 template <size_t Dim, typename LossFunc>
-void CalcDotDiffs(std::vector<Vector<Dim>> const & points, NeighboursLookup const & neighbours, std::vector<Vector<Dim>> & rets, LossFunc lossFunc)
+double RunInnerLoops(std::vector<Vector<Dim>> & state, NeighboursLookup const & neighbourLookup, std::vector<Vector<Dim>> & diffVect, size_t InnerIterationLoops, LossFunc lossFunc)
 {
-    static constexpr double DELTA = 1e-5;
-    static constexpr double QUAD_DELTA = 1;
-
-    std::vector<PointType> mags(points.size());
-
-    double maxForce = 0.1;
-
-    for (size_t i = 0; i < points.size(); i++)
+    double maxStepSq = 0;
+    for (size_t innerEpoch = 0; innerEpoch < InnerIterationLoops; innerEpoch++)
     {
-        mags[i] = std::sqrt(Dot(points[i], points[i]));
-        rets[i].Zero();
-    }
-    for (PointId pointId = 0; pointId < points.size(); pointId++)
-    {
-        auto const & point = points[pointId];
-
+        maxStepSq = CalcDotDiffs<Dim>(state, neighbourLookup, diffVect, lossFunc);
 
-        for (PointId neighbourId : neighbours[pointId])
+        for (size_t i = 0; i < state.size(); i++)
         {
-            auto & neighbour = points[neighbourId];
-
-            auto cos_theta = Dot(point, neighbour) / mags[pointId] / mags[neighbourId];
-
-            // boost[pointId].RegisterCosTheta(cos_theta);
-            // boost[neighbourId].RegisterCosTheta(cos_theta);
-
-            ASSERT_MSG(cos_theta <= 1.0000000001, "Cos theta was {}", cos_theta);
-
-            static constexpr PointType RAMP_IN = 5;
-
-            // Maybe we ramp this up over time instead?
-
-            if (cos_theta > 0.5 - (DELTA * RAMP_IN)) // points too close
-            {
-                // Give it this tiny bit of ramp in to try to help stability
-                auto THRESH = 0.5 - (DELTA * RAMP_IN);
-                auto scale = std::min(DELTA, (cos_theta - THRESH) / RAMP_IN);
-                // auto scale = DELTA;
-
-
-                // auto heaviside = (cos_theta > THRESH);
-                // auto heaviside = (cos_theta > THRESH) - (cos_theta <= THRESH && cos_theta > 0.45);
-                // auto heaviside = 1 / (1 + std::exp(-10000 *(cos_theta - THRESH)));
-                
-
-                // scale *= heaviside;
-
-                // scale *= (1 + std::min(boost[pointId].GetBoostValue(), boost[neighbourId].GetBoostValue()));
-
-                // What if we start chasing these numbers downwards after a while? "Cooling" as it were
-                // Would be nice to have a convergence checker
-
-                // Does a good job of preventing degenercy up to like 1.5, 1.6
-                // Seed 12359 converges to an optimum until about 1.2. 
-                // auto sf = exp(50 * (cos_theta - 0.5));
-                // double sf = 1;
-                double sf = lossFunc(cos_theta);
-                // ;
-                // auto sf = 1 / std::max(0.01, (1-cos_theta));
-
-                maxForce = std::max(sf, maxForce);
-
-
-                scale *= sf;
-
-                ApplyDiff(point, neighbour, cos_theta, scale, rets[pointId]);
-                ApplyDiff(neighbour, point, cos_theta, scale, rets[neighbourId]);      
-            }      
+            Acc(state[i], diffVect[i]);
         }
-        
-        // boost[pointId].EndLoop();
     }
 
-    for (size_t i = 0; i < points.size(); i++)
-    {
-        // Apply force to keep kissing dist - quadratic unlike the linear forces for pushing away
-
-        auto magError = (mags[i] - ScaledOne);
-        auto forceScale = std::min(magError * magError, ScaledOne);
-        auto force = std::signbit(magError) ? forceScale * QUAD_DELTA : -forceScale * QUAD_DELTA;
-
-        for (size_t j = 0; j < Dim; j++)
-        {
-            rets[i].mValues[j] /= maxForce;
-            rets[i].mValues[j] += force * points[i].mValues[j] / mags[i];
-        }
-    }
+    return maxStepSq;
 }
 
-template <size_t Dim>
-double CalcScore(std::vector<Vector<Dim>> const & state, NeighboursLookup & neighbourLookup)
+// Returns the number of outer epochs run and why it stopped. Large configurations are split across the pool if one is given,
+// and ones that outgrow L2 are kept in locality order while they run. The most searched sizes run a fixed size kernel. A run resumed from a keyframe starts at firstEpoch,
+// which keeps its checks and reorders on the same epochs as the original. With rigidity checks on, a run that is rigid and no longer improving
+// stops as jammed and one with a flex is pushed along it.
+template <size_t Dim, typename OutputT, typename LossFunc>
+LoopsResult RunLoops(std::vector<Vector<Dim>> & state, OutputT & frameOutput, size_t OuterEpochs, size_t InnerIterationLoops, LossFunc lossFunc, ThreadPool * pool, StagnationParams const & stagnation, PolishParams const & polish, RigidityParams const & rigidity, size_t firstEpoch)
 {
-    double score = 0;
-    for (PointId pointId = 0; pointId < state.size(); pointId++)
+    std::vector<Vector<Dim>> diffVect(state.size());
+    // std::vector<BoostState> boost(state.size());
+    for (auto & vec : diffVect)
     {
-        for (PointId neighbourId : neighbourLookup[pointId])
-        {
-            auto dotVal = Dot(state[pointId], state[neighbourId]) / ScaledOneSquared;
-            if (dotVal > 0.500000001)
-            {
-                score += (dotVal - 0.5);
-            }
-        }
+        vec.Zero();
     }
 
-    return score;
-}
-
-template <size_t Dim>
-bool HasConverged(std::vector<Vector<Dim>> const & diffs)
-{
-    for (auto const & vector : diffs)
+    std::optional<ParallelDescent<Dim>> parallel;
+    if (ParallelDescent<Dim>::Worthwhile(pool, state.size()))
     {
-        if (Dot(vector, vector) > 1e-18)
-        {
-            return false;
-        }
+        parallel.emplace(*pool, state.size());
     }
 
-    return true;
-}
+    std::optional<FixedDescent<Dim, FixedBalls<Dim>>> fixed;
+    if (!parallel && FixedDescent<Dim, FixedBalls<Dim>>::Worthwhile(state.size()))
+    {
+        fixed.emplace();
+    }
 
-template <size_t Dim, typename OutputT, typename LossFunc>
-void RunLoops(std::vector<Vector<Dim>> & state, OutputT & frameOutput, size_t OuterEpochs, size_t InnerIterationLoops, LossFunc lossFunc)
-{
-    std::vector<Vector<Dim>> diffVect(state.size());
-    // std::vector<BoostState> boost(state.size());
-    for (auto & vec : diffVect)
+    std::optional<LocalityOrder<Dim>> order;
+    if (LocalityOrder<Dim>::Worthwhile(state.size()))
     {
-        vec.Zero();
+        order.emplace(state.size());
     }
 
-    for (size_t outerEpoch = 0; outerEpoch < OuterEpochs; outerEpoch++)
+    auto finish = [&](size_t epochs, Termination termination) {
+        if (order)
+        {
+            order->Restore(state);
+        }
+        return LoopsResult{epochs, termination};
+    };
+
+    // The contact angle and neighbour margin come with the loss policy's step
+    auto const contact = StepOf(lossFunc).mContact;
+    auto const margin = NeighbourMarginFor(contact, StepOf(lossFunc).mNeighbourMargin);
+
+    ProgressTracker tracker(stagnation);
+    // Worst overlap the next polish is tried below - halved after each failed attempt
+    auto polishBelow = polish.mStartViolation;
+    auto nextRigidityCheck = std::max(firstEpoch, rigidity.mMinEpochs);
+    size_t flexPushes = 0;
+    auto lastRigidityScore = std::numeric_limits<double>::infinity();
+
+    NeighboursLookup neighbourLookup;
+    for (size_t outerEpoch = firstEpoch; outerEpoch < OuterEpochs; outerEpoch++)
     {
         // std::cout << outerEpoch << std::endl;
-        auto neighbourLookup = ConstructPointNeighbours(state);
-        frameOutput.WriteRow(state);
+        if (order && outerEpoch % LocalityOrder<Dim>::ReorderEpochs == 0)
+        {
+            // Neighbour lists are rebuilt below, so only state and diffs need permuting
+            order->Reorder(state, diffVect);
+        }
+        if constexpr (!DiscardsRows<OutputT>)
+        {
+            frameOutput.WriteRow(order ? order->InOriginalOrder(state) : state);
+        }
 
-        for (size_t innerEpoch = 0; innerEpoch < InnerIterationLoops; innerEpoch++)
+        double maxStepSq = 0;
+        if (parallel)
         {
-            CalcDotDiffs<Dim>(state, neighbourLookup, diffVect, lossFunc);        
-    	    
-            for (size_t i = 0; i < state.size(); i++)
-            {
-                Acc(state[i], diffVect[i]);
-            }
+            parallel->ConstructNeighbours(state, neighbourLookup, margin);
+            maxStepSq = parallel->RunInnerLoops(state, neighbourLookup, diffVect, InnerIterationLoops, lossFunc);
+        }
+        else if (fixed)
+        {
+            fixed->ConstructNeighbours(state, margin);
+            maxStepSq = fixed->RunInnerLoops(state, InnerIterationLoops, lossFunc);
+        }
+        else
+        {
+            neighbourLookup = ConstructPointNeighbours(state, margin);
+            maxStepSq = RunInnerLoops(state, neighbourLookup, diffVect, InnerIterationLoops, lossFunc);
+        }
+
+        if (maxStepSq <= ConvergedStepSq)
+        {
+            return finish(outerEpoch + 1, Termination::Converged);
         }
 
-        if (outerEpoch % 100 == 0)
+        if (tracker.Due(outerEpoch))
         {
-            if (HasConverged(diffVect))
+            if (fixed)
+            {
+                fixed->FillLookup(neighbourLookup);
+            }
+            auto violation = CalcViolation(state, neighbourLookup, contact);
+            if constexpr (requires { lossFunc.Update(outerEpoch, violation); })
+            {
+                lossFunc.Update(outerEpoch, violation);
+            }
+            if (violation.mMax > 0 && violation.mMax < polishBelow)
+            {
+                if (Polish(state, polish, contact))
+                {
+                    return finish(outerEpoch + 1, Termination::Polished);
+                }
+                polishBelow = violation.mMax / 2;
+            }
+
+            if (rigidity.mEveryEpochs && violation.mMax > 0 && outerEpoch >= nextRigidityCheck)
+            {
+                nextRigidityCheck = outerEpoch + rigidity.mEveryEpochs;
+                auto report = AnalyseRigidity(state, neighbourLookup, contact, rigidity);
+                if (!report.mAnalysed)
+                {
+                    // Too large now means too large for the rest of the run
+                    nextRigidityCheck = OuterEpochs;
+                }
+                auto stalled = violation.mScore > (1 - rigidity.mMinImprovement) * lastRigidityScore;
+                lastRigidityScore = violation.mScore;
+                if (report.Jammed() && stalled)
+                {
+                    return finish(outerEpoch + 1, Termination::Jammed);
+                }
+                if (report.mFlexes > 0 && flexPushes < rigidity.mMaxFlexPushes)
+                {
+                    PushAlongFlex(state, report.mFlex, rigidity.mFlexStep);
+                    flexPushes++;
+                }
+            }
+
+            if (auto termination = tracker.Check(outerEpoch, violation))
             {
-                // std::cerr<< outerEpoch << std::endl;
-                return;
+                return finish(outerEpoch + 1, *termination);
             }
         }
     }
+
+    return finish(OuterEpochs, Termination::Budget);
 }
 
-template <size_t Dim, typename OutputT> 
-double RunGradientDescent(std::vector<Vector<Dim>> & initialState, OutputT & frameOutput, size_t OuterEpochs, size_t InnerIterationLoops)
+template <size_t Dim, typename OutputT, typename LossFunc = ReciprocalLoss> 
+EngineResult RunGradientDescent(std::vector<Vector<Dim>> & initialState, OutputT & frameOutput, size_t OuterEpochs, size_t InnerIterationLoops, ThreadPool * pool = nullptr, LossFunc lossFunc = {}, StagnationParams const & stagnation = {}, PolishParams const & polish = {}, size_t firstEpoch = 0, RigidityParams const & rigidity = {})
 {
     auto & state = initialState;
     frameOutput.WriteRow(state);
 
-
-    // RunLoops(state, frameOutput, OuterEpochs, InnerIterationLoops, [](double cos_theta){ return exp(5 * (cos_theta - 0.5));});
-    RunLoops(state, frameOutput, OuterEpochs, InnerIterationLoops, [](double cos_theta){ return 1 / std::max(0.01, (1-cos_theta));});
+    auto loops = RunLoops(state, frameOutput, OuterEpochs, InnerIterationLoops, lossFunc, pool, stagnation, polish, rigidity, firstEpoch);
 
     Normalize(state, ScaledOne);
 
-    auto neighbourLookup = ConstructPointNeighbours(state);
-    return CalcScore(state, neighbourLookup);
+    // Scored at the default margin, which holds every overlapping pair whatever the descent ran at
+    auto contact = StepOf(lossFunc).mContact;
+    auto neighbourLookup = ConstructPointNeighbours(state, NeighbourMarginFor(contact));
+    return EngineResult{CalcScore(state, neighbourLookup, contact), loops.mEpochs, loops.mTermination};
 
 }
 
-template <size_t Dim, typename OutputT> 
-double RunGradientDescent(std::vector<Vector<Dim>> & initialState, OutputT & frameOutput)
+template <size_t Dim, typename OutputT, typename LossFunc = ReciprocalLoss> 
+EngineResult RunGradientDescent(std::vector<Vector<Dim>> & initialState, OutputT & frameOutput, size_t OuterEpochs, ThreadPool * pool = nullptr, LossFunc lossFunc = {}, StagnationParams const & stagnation = {}, PolishParams const & polish = {}, size_t firstEpoch = 0, RigidityParams const & rigidity = {})
 {
-    static constexpr size_t OuterEpochs = 20 * 1000;
-    static constexpr size_t InnerIterationLoops = 100;
+    return RunGradientDescent(initialState, frameOutput, OuterEpochs, DescentParams{}.mInnerLoops, pool, lossFunc, stagnation, polish, firstEpoch, rigidity);
+}
 
-    return RunGradientDescent(initialState, frameOutput, OuterEpochs, InnerIterationLoops);
+template <size_t Dim, typename OutputT> 
+EngineResult RunGradientDescent(std::vector<Vector<Dim>> & initialState, OutputT & frameOutput)
+{
+    return RunGradientDescent(initialState, frameOutput, DescentParams{}.mOuterEpochs);
 }
\ No newline at end of file
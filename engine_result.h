@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+
+// Why an engine stopped. Engines without early stopping always report Budget.
+enum class Termination
+{
+    // The descent stopped moving
+    Converged,
+    // Ran all the epochs it was given
+    Budget,
+    // Stopped improving at a positive score - a jammed configuration
+    Plateau,
+    // Hit the per seed wall clock limit
+    TimeLimit,
+    // Finished by the Gauss-Newton polish
+    Polished,
+    // Stopped at a pipeline stage's gate, too far off to be worth the next stage
+    Gated,
+    // The contact graph was rigid at a positive score - no flex left for the descent to follow
+    Jammed,
+};
+
+inline char const * TerminationName(Termination termination)
+{
+    switch (termination)
+    {
+        case Termination::Converged: return "converged";
+        case Termination::Budget: return "budget";
+        case Termination::Plateau: return "plateau";
+        case Termination::TimeLimit: return "time";
+        case Termination::Polished: return "polished";
+        case Termination::Gated: return "gated";
+        case Termination::Jammed: return "jammed";
+    }
+
+    return "unknown";
+}
+
+// What every engine hands back: the final CalcScore of the configuration (0 is a valid kissing
+// configuration) and how much of its budget it used, in the engine's own epochs.
+struct EngineResult
+{
+    double mScore;
+    size_t mEpochs;
+    Termination mTermination = Termination::Budget;
+};
@@ -0,0 +1,412 @@
+#pragma once
+
+#include "engine_result.h"
+#include "force_approach.h"
+#include "simulated_annealing.h"
+#include "parallel_tempering.h"
+#include "dot_gradient_descent.h"
+#include "basin_hopping.h"
+#include "pipeline.h"
+#include "file_output.h"
+#include <chrono>
+#include <concepts>
+#include <memory>
+#include <string>
+#include <variant>
+
+// Every engine takes a configuration in place, an rng, an output sink and a budget in its own
+// epochs (0 means the engine's default), and hands back the final score and epochs used.
+// Engines hold no mutable state of their own, so one instance can be shared by every worker.
+template <typename EngineT, size_t Dim, typename Rand, typename OutputT>
+concept Engine = requires(EngineT const & engine, std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) {
+    { engine.template Run<Dim>(state, rand, output, budget) } -> std::same_as<EngineResult>;
+    { engine.DefaultBudget() } -> std::convertible_to<size_t>;
+};
+
+// Cos theta an engine scores its configurations at - 0.5 unless it takes a contact angle
+template <typename EngineT>
+double EngineContact(EngineT const & engine)
+{
+    if constexpr (requires { engine.mContact; })
+    {
+        return engine.mContact;
+    }
+    return 0.5;
+}
+
+// The descent constants an engine pushes pairs with - the defaults unless it runs the descent
+template <typename EngineT>
+DescentParams EngineDescent(EngineT const & engine)
+{
+    if constexpr (requires { engine.mDescent; })
+    {
+        return engine.mDescent;
+    }
+    return DescentParams{};
+}
+
+// Configuration's score at contact, counting the same pairs as the descent
+template <size_t Dim>
+double ScoreAtContact(std::vector<Vector<Dim>> const & state, double contact)
+{
+    return CalcScore(state, ConstructPointNeighbours(state, NeighbourMarginFor(contact)), contact);
+}
+
+struct GradientDescentEngine
+{
+    // Splits large configurations across cores - only for runs with a single worker
+    ThreadPool * mPool = nullptr;
+    LossKind mLoss = LossKind::Reciprocal;
+    StagnationParams mStagnation;
+    PolishParams mPolish;
+    ContinuationParams mContinuation;
+    RigidityParams mRigidity;
+    DescentParams mDescent;
+    // Cos theta of contact, 0.5 for kissing
+    double mContact = 0.5;
+
+    size_t DefaultBudget() const
+    {
+        return mDescent.mOuterEpochs;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        (void) rand;
+        return Resume(state, output, budget, 0);
+    }
+
+    // Picks a run up from its state at the start of firstEpoch. The descent draws no random
+    // numbers, so positions alone replay the rest of the run.
+    template <size_t Dim, typename OutputT>
+    EngineResult Resume(std::vector<Vector<Dim>> & state, OutputT & output, size_t budget, size_t firstEpoch) const
+    {
+        EngineResult ret;
+        WithLoss(mLoss, [&](auto lossFunc) {
+            auto run = [&](auto policy) {
+                ret = RunGradientDescent(state, output, budget ? budget : DefaultBudget(), mDescent.mInnerLoops, mPool, policy, mStagnation, mPolish, firstEpoch, mRigidity);
+            };
+
+            auto step = mDescent.Step(mContact);
+            if (mContinuation.mStartViolation > 0)
+            {
+                auto params = mContinuation;
+                params.mStartStep.mContact = mContact;
+                params.mStartStep.mQuadDelta = step.mQuadDelta;
+                params.mStartStep.mNeighbourMargin = step.mNeighbourMargin;
+                ContinuationLoss<decltype(lossFunc)> scheduled{lossFunc, params, step};
+                run(scheduled);
+            }
+            else if (step != PairStep{})
+            {
+                run(SteppedLoss<decltype(lossFunc)>{lossFunc, step});
+            }
+            else
+            {
+                run(lossFunc);
+            }
+        }, mDescent.mLossClamp);
+        return ret;
+    }
+};
+
+struct ForceEngine
+{
+    size_t DefaultBudget() const
+    {
+        return 100 * 1000;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        return RunRoutine(state, rand, output, budget ? budget : DefaultBudget());
+    }
+};
+
+struct AnnealingEngine
+{
+    size_t DefaultBudget() const
+    {
+        return 100;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        return RunAnnealing(state, rand, output, budget ? budget : DefaultBudget());
+    }
+};
+
+struct TemperingEngine
+{
+    TemperingParams mParams;
+
+    size_t DefaultBudget() const
+    {
+        return mParams.mSwapRounds;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        auto params = mParams;
+        params.mSwapRounds = budget ? budget : DefaultBudget();
+        RunParallelTempering(state, rand, output, params);
+
+        Normalize(state, ScaledOne);
+        auto neighbourLookup = ConstructPointNeighbours(state);
+        return EngineResult{CalcScore(state, neighbourLookup), params.mSwapRounds};
+    }
+};
+
+// Gradient descent to a near miss, then basin hopping from it. Budget is hop rounds.
+struct BasinHoppingEngine
+{
+    BasinHoppingParams mParams;
+    LossKind mLoss = LossKind::Reciprocal;
+    StagnationParams mStagnation;
+    PolishParams mPolish;
+
+    size_t DefaultBudget() const
+    {
+        return mParams.mRounds;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        auto params = mParams;
+        params.mRounds = budget ? budget : DefaultBudget();
+        EngineResult ret;
+        WithLoss(mLoss, [&](auto lossFunc) {
+            ret = RunBasinHopping(state, rand, output, params, lossFunc, mStagnation, mPolish);
+        });
+        return ret;
+    }
+};
+
+// Gauss-Newton polish on its own - only useful as the last stage of a pipeline. Budget is
+// iterations.
+struct PolishEngine
+{
+    PolishParams mParams;
+    double mContact = 0.5;
+
+    size_t DefaultBudget() const
+    {
+        return mParams.mMaxIterations;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        (void) rand;
+        auto params = mParams;
+        params.mMaxIterations = budget ? budget : DefaultBudget();
+        if (Polish(state, params, mContact))
+        {
+            output.WriteRow(state);
+            return EngineResult{0, 1, Termination::Polished};
+        }
+
+        Normalize(state, ScaledOne);
+        return EngineResult{ScoreAtContact(state, mContact), 1, Termination::Budget};
+    }
+};
+
+enum class EngineKind
+{
+    GradientDescent,
+    Force,
+    Annealing,
+    Tempering,
+    BasinHopping,
+    Polish,
+    // Chained engines, configured by --pipeline rather than by name
+    Pipeline,
+};
+
+inline EngineKind ParseEngineKind(std::string const & name)
+{
+    if (name == "gd") { return EngineKind::GradientDescent; }
+    if (name == "force") { return EngineKind::Force; }
+    if (name == "anneal") { return EngineKind::Annealing; }
+    if (name == "tempering") { return EngineKind::Tempering; }
+    if (name == "hop") { return EngineKind::BasinHopping; }
+    if (name == "polish") { return EngineKind::Polish; }
+
+    ASSERT_MSG(false, "unknown engine {} - choose one of gd, force, anneal, tempering, hop, polish", name);
+    return EngineKind::GradientDescent;
+}
+
+inline char const * EngineName(EngineKind kind)
+{
+    switch (kind)
+    {
+        case EngineKind::GradientDescent: return "gd";
+        case EngineKind::Force: return "force";
+        case EngineKind::Annealing: return "anneal";
+        case EngineKind::Tempering: return "tempering";
+        case EngineKind::BasinHopping: return "hop";
+        case EngineKind::Polish: return "polish";
+        case EngineKind::Pipeline: return "pipeline";
+    }
+
+    return "unknown";
+}
+
+struct EngineOptions
+{
+    EngineKind mKind = EngineKind::GradientDescent;
+    // Threads a single configuration may use
+    size_t mThreadsPerSeed = 1;
+    // Pair loss of the gradient descent
+    LossKind mLoss = LossKind::Reciprocal;
+    // When the gradient descent gives up on a seed early
+    StagnationParams mStagnation;
+    PolishParams mPolish;
+    ContinuationParams mContinuation;
+    RigidityParams mRigidity;
+    // Step constants of the gradient descent
+    DescentParams mDescent;
+    // Contact cos theta of the gradient descent, the other engines kiss at 0.5
+    double mContact = 0.5;
+    // Stages of the pipeline engine
+    std::vector<PipelineStageSpec> mPipeline;
+};
+
+using SingleEngine = std::variant<GradientDescentEngine, ForceEngine, AnnealingEngine, TemperingEngine, BasinHoppingEngine, PolishEngine>;
+
+// An engine of kind (anything but a pipeline) configured from options. pool splits gradient
+// descents and may be null.
+inline SingleEngine MakeEngine(EngineKind kind, EngineOptions const & options, ThreadPool * pool)
+{
+    switch (kind)
+    {
+        case EngineKind::GradientDescent:
+        {
+            GradientDescentEngine engine;
+            engine.mPool = pool;
+            engine.mLoss = options.mLoss;
+            engine.mStagnation = options.mStagnation;
+            engine.mPolish = options.mPolish;
+            engine.mContinuation = options.mContinuation;
+            engine.mRigidity = options.mRigidity;
+            engine.mDescent = options.mDescent;
+            engine.mContact = options.mContact;
+            return engine;
+        }
+        case EngineKind::Force:
+            return ForceEngine{};
+        case EngineKind::Annealing:
+            return AnnealingEngine{};
+        case EngineKind::Tempering:
+        {
+            TemperingEngine engine;
+            engine.mParams.mThreads = options.mThreadsPerSeed;
+            return engine;
+        }
+        case EngineKind::BasinHopping:
+        {
+            BasinHoppingEngine engine;
+            engine.mParams.mThreads = options.mThreadsPerSeed;
+            engine.mLoss = options.mLoss;
+            engine.mStagnation = options.mStagnation;
+            engine.mPolish = options.mPolish;
+            return engine;
+        }
+        case EngineKind::Polish:
+            return PolishEngine{options.mPolish, options.mContact};
+        case EngineKind::Pipeline:
+            break;
+    }
+
+    ASSERT_MSG(false, "a pipeline cannot be a pipeline stage");
+    return ForceEngine{};
+}
+
+// Runs the stages of a pipeline (pipeline.h) in turn on the same configuration. The budget
+// passed in is ignored - each stage has its own. Epochs are summed over the stages run, and the
+// termination is the last stage's, or Gated if the seed was stopped at a gate.
+struct PipelineEngine
+{
+    struct Stage
+    {
+        SingleEngine mEngine;
+        size_t mBudget;
+        double mMaxScore;
+    };
+
+    std::vector<Stage> mStages;
+    // Cos theta the gates score at, as the stages do
+    double mContact = 0.5;
+    // Shared by every worker running the engine
+    std::shared_ptr<PipelineStats> mStats;
+
+    size_t DefaultBudget() const
+    {
+        return 0;
+    }
+
+    template <size_t Dim, typename Rand, typename OutputT>
+    EngineResult Run(std::vector<Vector<Dim>> & state, Rand & rand, OutputT & output, size_t budget) const
+    {
+        (void) budget;
+        // Every stage engine is instantiated once, not once per output the pipeline runs with
+        AnyOutput<Dim> anyOutput(output);
+        EngineResult ret{ScoreAtContact(state, mContact), 0};
+        for (size_t i = 0; i < mStages.size() && ret.mScore > 0; i++)
+        {
+            auto const & stage = mStages[i];
+            if (ret.mScore > stage.mMaxScore)
+            {
+                mStats->RecordGated(i);
+                ret.mTermination = Termination::Gated;
+                break;
+            }
+
+            auto startTime = std::chrono::steady_clock::now();
+            auto result = std::visit([&](auto const & engine) { return engine.template Run<Dim>(state, rand, anyOutput, stage.mBudget); }, stage.mEngine);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+            mStats->RecordRun(i, result, elapsed.count());
+
+            ret = EngineResult{result.mScore, ret.mEpochs + result.mEpochs, result.mTermination};
+        }
+
+        return ret;
+    }
+};
+
+// Calls func with a concrete engine so the whole worker loop is instantiated per engine and
+// nothing is dispatched per iteration. A pipeline's per stage outcomes are printed once func
+// returns.
+template <typename Func>
+void WithEngine(EngineOptions const & options, Func && func)
+{
+    std::optional<ThreadPool> pool;
+    if (options.mThreadsPerSeed > 1 && (options.mKind == EngineKind::GradientDescent || options.mKind == EngineKind::Pipeline))
+    {
+        pool.emplace(options.mThreadsPerSeed);
+    }
+    auto * poolPtr = pool ? &*pool : nullptr;
+
+    if (options.mKind == EngineKind::Pipeline)
+    {
+        ASSERT_MSG(!options.mPipeline.empty(), "the pipeline engine needs --pipeline <stages>");
+        PipelineEngine engine;
+        for (auto const & stage : options.mPipeline)
+        {
+            engine.mStages.push_back(PipelineEngine::Stage{MakeEngine(ParseEngineKind(stage.mEngine), options, poolPtr), stage.mBudget, stage.mMaxScore});
+        }
+        engine.mContact = options.mContact;
+        engine.mStats = std::make_shared<PipelineStats>(options.mPipeline);
+
+        func(engine);
+        engine.mStats->Print(std::cerr);
+        return;
+    }
+
+    std::visit([&](auto const & engine) { func(engine); }, MakeEngine(options.mKind, options, poolPtr));
+}
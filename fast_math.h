@@ -0,0 +1,65 @@
+#pragma once
+
+#include <bit>
+#include <limits>
+#include <numbers>
+#include <stdint.h>
+
+// Branch free log and exp built from plain arithmetic and bit casts, so loops calling them
+// vectorise (std::log and std::exp are opaque calls without a vector math library). Integer
+// work stays unsigned 64 bit adds, ands and shifts, and exponents are converted through a double
+// bit pattern, as AVX has no vector int64 converts.
+
+// Natural log of a positive normal x: split off the exponent, then atanh series around 1 for the
+// mantissa scaled into [sqrt(1/2), sqrt(2)). Relative error about 1e-15.
+inline double FastLog(double x)
+{
+    static constexpr uint64_t SqrtHalfBits = 0x3FE6A09E667F3BCDull;
+    static constexpr uint64_t ExponentOffset = 1024ull << 52;
+    static constexpr uint64_t TwoTo52Bits = 0x4330000000000000ull;
+
+    // Offset the exponent so the subtraction can't wrap for small x
+    auto bits = std::bit_cast<uint64_t>(x) - SqrtHalfBits + ExponentOffset;
+    auto exponent = std::bit_cast<double>((bits >> 52) | TwoTo52Bits) - (0x1p52 + 1024);
+    auto mantissa = std::bit_cast<double>((bits & 0x000FFFFFFFFFFFFFull) + SqrtHalfBits);
+
+    auto t = (mantissa - 1) / (mantissa + 1);
+    auto t2 = t * t;
+    auto series = 1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7 + t2 * (1.0 / 9 + t2 * (1.0 / 11 + t2 * (1.0 / 13 + t2 * (1.0 / 15 + t2 * (1.0 / 17))))))));
+    return exponent * std::numbers::ln2 + 2 * t * series;
+}
+
+// e^x: x = n ln2 + r with |r| <= ln2 / 2, Taylor for e^r, 2^n assembled in the exponent bits.
+// Relative error about 1e-15. Below -708 the result would be subnormal and is 0 instead, above 710
+// it is +inf (between 709.79 and 710 it overflows to +inf on its own), and NaN stays NaN.
+inline double FastExp(double x)
+{
+    // Adding and subtracting 1.5 * 2^52 rounds to the nearest integer in the current mode
+    static constexpr double RoundMagic = 0x1.8p52;
+    // ln2 split so n * Ln2Hi is exact
+    static constexpr double Ln2Hi = 0x1.62e42fee00000p-1;
+    static constexpr double Ln2Lo = 0x1.a39ef35793c76p-33;
+    // Where n is still in [-1021, 1024], so 2^(n - 1) has a normal exponent
+    static constexpr double MinArg = -708;
+    static constexpr double MaxArg = 710;
+
+    auto n = (x * std::numbers::log2e + RoundMagic) - RoundMagic;
+    auto r = (x - n * Ln2Hi) - n * Ln2Lo;
+
+    // Horner over 1/k! up to r^12
+    double series = 1;
+    for (int k = 12; k > 0; k--)
+    {
+        series = 1 + series * r * (1.0 / k);
+    }
+
+    // n + 1022 sits in the low mantissa bits of (n + 1022 + 2^52); move it up to the exponent.
+    // Building 2^(n - 1) and doubling reaches n = 1024 without an infinite exponent.
+    auto biased = std::bit_cast<uint64_t>(n + (0x1p52 + 1022));
+    auto scale = std::bit_cast<double>(biased << 52);
+    auto ret = series * scale * 2;
+
+    // Selects rather than branches, so loops calling this still vectorise
+    ret = x < MinArg ? 0.0 : ret;
+    return x > MaxArg ? std::numeric_limits<double>::infinity() : ret;
+}
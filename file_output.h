@@ -3,6 +3,7 @@
 #include "types.h"
 #include "debug_output.h"
 #include <fstream>
+#include <functional>
 
 
 
@@ -64,4 +65,30 @@ class NoOutput
     void Close()
     {        
     }
-};
\ No newline at end of file
+};
+
+// Outputs that drop every row, so a caller can skip building rows just to hand them over.
+// Wrappers count as keeping them, whatever they wrap.
+template <typename OutputT>
+inline constexpr bool DiscardsRows = false;
+
+template <>
+inline constexpr bool DiscardsRows<NoOutput> = true;
+
+// Any output behind one type, so code that takes an output is instantiated once rather than per
+// output it is run with. A row costs an indirect call.
+template <size_t Dim>
+class AnyOutput
+{
+    public:
+    template <typename OutputT>
+    AnyOutput(OutputT & output) : mWriteRow([&output](std::vector<Vector<Dim>> const & row) { output.WriteRow(row); }) {
+    }
+
+    void WriteRow(std::vector<Vector<Dim>> const & row) {
+        mWriteRow(row);
+    }
+
+    private:
+    std::function<void(std::vector<Vector<Dim>> const &)> mWriteRow;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "dot_diffs.h"
+#include "kernel_dispatch.h"
+#include "neighbours.h"
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+
+// The ball count each dimension gets a fixed size descent kernel for - the kissing
+// configurations searched most. Other counts run the dynamic path.
+template <size_t Dim>
+inline constexpr size_t FixedBalls = Dim == 3 ? 12 : Dim == 4 ? 24 : Dim == 5 ? 40 : 0;
+
+// The descent's inner loops for a configuration of exactly N balls. Points, steps, magnitudes and
+// neighbour lists are std::arrays held in the object, which RunLoops keeps on its stack, so an
+// inner iteration touches a few KB with no heap allocation or pointer chasing. Neighbours are
+// found as one bitset word per point, then expanded to byte ids in the same order as
+// ConstructPointNeighbours, so results match the dynamic path bit for bit.
+template <size_t Dim, size_t N>
+class FixedDescent
+{
+    public:
+    static_assert(N <= 64, "a point's neighbour set is one 64 bit word");
+
+    static bool Worthwhile(size_t nPoints)
+    {
+        return N > 0 && nPoints == N;
+    }
+
+    // Same pairs as ConstructPointNeighbours
+    KISSING_KERNEL void ConstructNeighbours(std::vector<Vector<Dim>> const & points, double margin)
+    {
+        for (PointId pointId = 0; pointId < N; pointId++)
+        {
+            uint64_t higher = 0;
+            for (PointId neighbourId = pointId + 1; neighbourId < N; neighbourId++)
+            {
+                higher |= uint64_t{CloserThanSafe(points[pointId], points[neighbourId], margin)} << neighbourId;
+            }
+
+            mCounts[pointId] = 0;
+            for (; higher; higher &= higher - 1)
+            {
+                mNeighbours[pointId][mCounts[pointId]++] = static_cast<uint8_t>(std::countr_zero(higher));
+            }
+        }
+    }
+
+    // The pairs as a lookup, for the checks that score the configuration
+    void FillLookup(NeighboursLookup & lookup) const
+    {
+        lookup.resize(N);
+        for (PointId pointId = 0; pointId < N; pointId++)
+        {
+            lookup[pointId].assign(mNeighbours[pointId].begin(), mNeighbours[pointId].begin() + mCounts[pointId]);
+        }
+    }
+
+    // Equivalent to InnerIterationLoops rounds of CalcDotDiffs followed by Acc into the state.
+    // Returns the largest squared step of the last round.
+    template <typename LossFunc>
+    double RunInnerLoops(std::vector<Vector<Dim>> & state, size_t InnerIterationLoops, LossFunc lossFunc)
+    {
+        std::copy(state.begin(), state.end(), mPoints.begin());
+        auto const quadDelta = StepOf(lossFunc).mQuadDelta;
+
+        double maxStepSq = 0;
+        for (size_t innerEpoch = 0; innerEpoch < InnerIterationLoops; innerEpoch++)
+        {
+            for (size_t i = 0; i < N; i++)
+            {
+                mMags[i] = std::sqrt(Dot(mPoints[i], mPoints[i]));
+                mInvMags[i] = 1 / mMags[i];
+                mRets[i].Zero();
+            }
+
+            double maxForce = 0.1;
+            for (PointId pointId = 0; pointId < N; pointId++)
+            {
+                std::span<uint8_t const> neighbours(mNeighbours[pointId].data(), mCounts[pointId]);
+                maxForce = AccumulatePairDiffs<Dim>(mPoints, mMags, mInvMags, neighbours, pointId, mRets, lossFunc, maxForce);
+            }
+
+            maxStepSq = 0;
+            for (size_t i = 0; i < N; i++)
+            {
+                FinishDiff(mPoints[i], mMags[i], maxForce, mRets[i], quadDelta);
+                maxStepSq = std::max(maxStepSq, Dot(mRets[i], mRets[i]));
+            }
+            for (size_t i = 0; i < N; i++)
+            {
+                Acc(mPoints[i], mRets[i]);
+            }
+        }
+
+        std::copy(mPoints.begin(), mPoints.end(), state.begin());
+        return maxStepSq;
+    }
+
+    private:
+    std::array<Vector<Dim>, N> mPoints;
+    std::array<Vector<Dim>, N> mRets;
+    std::array<PointType, N> mMags;
+    std::array<PointType, N> mInvMags;
+    std::array<std::array<uint8_t, N>, N> mNeighbours;
+    std::array<uint8_t, N> mCounts;
+};
@@ -3,6 +3,8 @@
 
 
 #include "neighbours.h"
+#include "engine_result.h"
+#include "dot_gradient_descent.h"
 
 
 
@@ -34,12 +36,11 @@ void CalcRoundOfDiffs(std::vector<Vector<Dim>> const & points, NeighboursLookup
 
                 PointType dist = std::sqrt(distsq);
 
-                static constexpr auto MinScale = 1 << 10;
+                // 1 << 10 in integer points
+                static constexpr PointType MinScale = ScaledOne / (1 << 20);
 
                 auto scaleFactor = (ScaledOne - dist + MinScale);
 
-                DEBUG_LOG("%lu\n", scaleFactor);
-
                 for (size_t i = 0; i < Dim; i++)
                 {
                     // Scale quadratically to encourage even distn of points when over saturated
@@ -96,8 +97,7 @@ void ApplyUnstick(std::vector<Vector<Dim>> & diffVectors, Rand & rand)
 template <size_t Dim> 
 void ApplyRecenter(std::vector<Vector<Dim>> & state)
 {
-    // Should probably not actually make this static...
-    static Vector<Dim> working;
+    Vector<Dim> working;
     working.Zero();
 
     for (auto const & vect : state)
@@ -128,51 +128,16 @@ void ApplyDiffs(std::vector<Vector<Dim>> & state, std::vector<Vector<Dim>> & dif
     {
         for (size_t j = 0; j < Dim; j++)
         {
-            state[i].mValues[j] += ((diffVects[i].mValues[j] + DiffScaleDivisor) / DiffScaleDivisor);
+            state[i].mValues[j] += Divide(diffVects[i].mValues[j], DiffScaleDivisor);
         }
     }
 }
 
 
-template <size_t Dim> 
-void ApplyDiffsOrth(std::vector<Vector<Dim>> & state, std::vector<Vector<Dim>> & diffVects)
+template <size_t Dim, typename Rand, typename OutputT> 
+EngineResult RunRoutine(std::vector<Vector<Dim>> & initialState, Rand & rand, OutputT & frameOutput, size_t OuterEpochs)
 {
-    // If we applied all pushes with a factor of 1/2 (as we apply the push to both balls)
-    // we'd pop all the balls out to not be overlapping in a single iteration (Unless it's overlapping multiple balls). 
-    // Let's slow this process a bit as it feels like it could be unstable if it shoots stuff straight into other balls
-    static constexpr auto DiffScaleDivisor = 1 * 2;
-
-    // We'll scale this down at the end to finish
-
-    for (size_t i = 0; i < state.size(); i++)
-    {
-        auto & diffVect = diffVects[i];
-        auto & stateVect = state[i];
-        auto diffSize = std::sqrt(Dot(diffVect, diffVect));
-        auto orthComp = Dot(diffVect, stateVect) / ScaledOne;
-        
-        for (size_t j = 0; j < Dim; j++)
-        {
-            diffVect.mValues[j] -= (stateVect.mValues[j] * orthComp) / ScaledOne;
-        }
-
-        // Adding 1 to denom to avoid issues with dividing by tiny numbers
-        auto orthDiffSize = std::sqrt(Dot(diffVect, diffVect)) + 1;
-
-        for (size_t j = 0; j < Dim; j++)
-        {
-            stateVect.mValues[j] += ((diffVect.mValues[j] + DiffScaleDivisor) * diffSize / DiffScaleDivisor / orthDiffSize);
-        }
-    }
-}
-
-
-template <size_t Dim, typename Rand> 
-bool RunRoutine(std::vector<Vector<Dim>> & initialState, Rand & rand)
-{
-    FileOutput frameOutput("viewer/frames.json");
     auto & state = initialState;
-    static constexpr size_t OuterEpochs = 100 * 1000;
     static constexpr size_t UnstickCadence = 1000;
     static constexpr size_t RecenterCadence = 1000;
     static constexpr size_t InnerIterationLoops = 1;
@@ -184,11 +149,9 @@ bool RunRoutine(std::vector<Vector<Dim>> & initialState, Rand & rand)
         vec.Zero();
     }
 
-    for (size_t outerEpoch = 0; outerEpoch < OuterEpochs; outerEpoch++)
+    size_t outerEpoch = 0;
+    for (; outerEpoch < OuterEpochs; outerEpoch++)
     {
-        DEBUG_LOG("[OuterEpoch=%lu] Before Normalization:", outerEpoch);
-        DEBUG_LOG_VECTS(state);
-
         // static constexpr PointType MIN_SCALE = (7 * ScaledOne) / 8;
         // static constexpr PointType END_SCALE_EPOCH = (7 * OuterEpochs) / 8;
 
@@ -197,8 +160,6 @@ bool RunRoutine(std::vector<Vector<Dim>> & initialState, Rand & rand)
         PointType scale = ScaledOne;
 
         Normalize(state, scale);
-        DEBUG_LOG("[OuterEpoch=%lu] After Normalization:", outerEpoch);
-        DEBUG_LOG_VECTS(state);
 
         if (outerEpoch % RecenterCadence == 0)
         {
@@ -206,22 +167,18 @@ bool RunRoutine(std::vector<Vector<Dim>> & initialState, Rand & rand)
             Normalize(state, scale);
         }
 
-        auto neighbourLookup = ConstructPointNeighbours(state, ScaledBound(1.2));
+        auto neighbourLookup = ConstructPointNeighbours(state, NeighbourMarginFor(0.5));
         // DEBUG_LOG_LOOKUP(neighbourLookup);
 
+        bool converged = false;
         for (size_t innerEpoch = 0; innerEpoch < InnerIterationLoops; innerEpoch++)
         {
             frameOutput.WriteRow(state);
             CalcRoundOfDiffs(state, neighbourLookup, diffVect);
-            DEBUG_LOG("[OuterEpoch=%lu][InnerEpoch=%lu]Diffs pre-scaling:", outerEpoch, innerEpoch);
-            DEBUG_LOG_VECTS(diffVect);
-
-            if (innerEpoch == 0) {
-                if (AllZero(diffVect)) {
-                    printf("[OuterEpoch=%lu][InnerEpoch=%lu] No diffs in iteration, exiting, final values:\n", outerEpoch, innerEpoch);
-                    PrintVects(state);
-                    return true;
-                }
+
+            if (innerEpoch == 0 && AllZero(diffVect)) {
+                converged = true;
+                break;
             }
 
             if (outerEpoch % UnstickCadence == 0)
@@ -231,11 +188,14 @@ bool RunRoutine(std::vector<Vector<Dim>> & initialState, Rand & rand)
             
 	    ApplyDiffs(state, diffVect);
         }
-    }
 
-    
-    printf("No Soltuion found after %lu iterations:\n", OuterEpochs);
-    PrintVects(state);
+        if (converged)
+        {
+            break;
+        }
+    }
 
-    return false;
-}
\ No newline at end of file
+    Normalize(state, ScaledOne);
+    auto neighbourLookup = ConstructPointNeighbours(state);
+    return EngineResult{CalcScore(state, neighbourLookup), outerEpoch, outerEpoch < OuterEpochs ? Termination::Converged : Termination::Budget};
+}
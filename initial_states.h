@@ -3,6 +3,7 @@
 #include "types.h"
 #include "vectors.h"
 #include "rotation_matrix.h"
+#include "philox.h"
 #include <random>
 #include <numbers>
 
@@ -20,7 +21,7 @@ Vector<Dim> RandPoint(PointType stddev, Rand & rand)
     Vector<Dim> ret;
     for (size_t i = 0; i < Dim; i++)
     {
-        ret.mValues[i] = static_cast<PointType>(gauss(rand) * stddev);
+        ret.mValues[i] = static_cast<PointType>(DrawGaussian(rand, gauss) * stddev);
     }
 
     return ret;
@@ -105,60 +106,6 @@ void AddNoise(Rand & rand, std::vector<Vector<Dim>> & state, PointType scale)
     Normalize(state, ScaledOne);
 }
 
-template <typename Rand>
-std::vector<Vector<4>> Initialize4D(Rand & rand)
-{
-    std::vector<Vector<4>> ret;
-    std::vector<PointType> signs{-ScaledOne, ScaledOne};
-    for (int i = 0; i < 4; i++)
-    {
-        for (int j = i + 1; j < 4; j++)
-        {
-            for (auto s1 : signs)
-            {
-                for (auto s2 : signs)
-                {
-                    auto & n = ret.emplace_back();
-                    n.Zero();
-                    n.mValues[i] = s1;
-                    n.mValues[j] = s2;
-                    n.Add(RandPointOnSphere<4>(ScaledOne / RANDOM_PROPORTION, rand));
-                }
-            }
-    
-        }
-    }
-
-    return ret;
-}
-
-template <typename Rand>
-std::vector<Vector<5>> Initialize5D(Rand & rand)
-{
-    std::vector<Vector<5>> ret;
-    std::vector<PointType> signs{-ScaledOne, ScaledOne};
-    for (int i = 0; i < 5; i++)
-    {
-        for (int j = i + 1; j < 5; j++)
-        {
-            for (auto s1 : signs)
-            {
-                for (auto s2 : signs)
-                {
-                    auto & n = ret.emplace_back();
-                    n.Zero();
-                    n.mValues[i] = s1;
-                    n.mValues[j] = s2;
-                    n.Add(RandPointOnSphere<5>(ScaledOne / RANDOM_PROPORTION, rand));
-                }
-            }
-    
-        }
-    }
-
-    return ret;
-}
-
 double GetCoord(size_t i, size_t stratInLayer)
 {
     return ((i * ScaledOne * 2) / (stratInLayer - 1)) - ScaledOne;
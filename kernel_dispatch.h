@@ -0,0 +1,33 @@
+#pragma once
+
+// The binary is built for a baseline x86-64 (SSE4.2, see CMakeLists.txt) so it runs anywhere.
+// Hot kernels marked KISSING_KERNEL are also compiled for AVX2+FMA (x86-64-v3) and AVX-512
+// (x86-64-v4), and the loader picks the widest the machine supports from cpuid, once, through
+// an ifunc. The small helpers a kernel calls (Dot, the loss functions) are inlined into each
+// clone anyway; the drivers around the kernels stay baseline, as cloning and flattening them
+// compiled every engine three times over.
+// Mark innermost loops that do enough work per call to pay for going through the ifunc.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && !defined(KISSING_NO_DISPATCH)
+#define KISSING_KERNEL __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define KISSING_KERNEL
+#endif
+
+// The kernel variant the loader picks on this machine
+inline char const * KernelIsaName()
+{
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && !defined(KISSING_NO_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("x86-64-v4"))
+    {
+        return "avx512";
+    }
+    if (__builtin_cpu_supports("x86-64-v3"))
+    {
+        return "avx2";
+    }
+    return "baseline";
+#else
+    return "native";
+#endif
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "debug_output.h"
+#include "descent_params.h"
+#include "loss_functions.h"
+#include "types.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Sparse checkpoints of a gradient descent, so analyse can replay the end of a seed without
+// re-running it from the start. Frame 0 of a descent is its start state and frame e + 1 opens
+// epoch e, so a keyframe is the state at the start of every Kth epoch. The descent is
+// deterministic given positions and its settings, so a keyframe restores it exactly as long as
+// the replay runs with the same settings and K is a multiple of LocalityOrder::ReorderEpochs.
+// The settings are recorded with the keyframes: a replay takes the thread count from them and
+// refuses to run with any other loss, contact or descent constants.
+//
+// One file per seed, <dir>/seed_<seed>.kf (little endian):
+//   "KSKEY3\0\0", u32 dim, u32 balls, u64 seed, u32 threads per seed, u32 loss kind,
+//     f64 contact, the descent constants in ForEachDescentField order (u64 counts, f64 the
+//     rest), u64 keyframe count, then per keyframe
+//     u64 epoch, f64 points[balls x dim]
+// Points are kept at full precision - a rounded keyframe replays a different run.
+template <size_t Dim>
+struct Keyframe
+{
+    static_assert(sizeof(Vector<Dim>) == Dim * sizeof(double), "keyframes write points as raw f64");
+
+    size_t mEpoch;
+    std::vector<Vector<Dim>> mState;
+};
+
+// The settings a run's keyframes only replay exactly under
+struct KeyframeRunSettings
+{
+    // Splitting a configuration across threads sums its pushes in another order
+    size_t mThreadsPerSeed = 1;
+    LossKind mLoss = LossKind::Reciprocal;
+    double mContact = 0.5;
+    DescentParams mDescent;
+
+    bool SameDescent(KeyframeRunSettings const & other) const
+    {
+        // Outer epochs only say where a run stops, not how it gets there
+        auto otherDescent = other.mDescent;
+        otherDescent.mOuterEpochs = mDescent.mOuterEpochs;
+        return mLoss == other.mLoss && mContact == other.mContact && mDescent == otherDescent;
+    }
+};
+
+template <size_t Dim>
+struct SeedKeyframes
+{
+    // As the run that wrote them
+    KeyframeRunSettings mSettings;
+    std::vector<Keyframe<Dim>> mKeyframes;
+};
+
+class KeyframeStore
+{
+    public:
+    // Keeps every epochStride epochs of seeds finishing at or below maxScore, from runs with settings
+    KeyframeStore(std::filesystem::path dir, size_t epochStride, KeyframeRunSettings const & settings, double maxScore = std::numeric_limits<double>::infinity())
+        : mDir(std::move(dir))
+        , mEpochStride(epochStride)
+        , mSettings(settings)
+        , mMaxScore(maxScore)
+    {
+        ASSERT_MSG(epochStride > 0, "keyframe stride must be positive");
+    }
+
+    size_t EpochStride() const
+    {
+        return mEpochStride;
+    }
+
+    bool Keeps(double finalScore) const
+    {
+        return finalScore <= mMaxScore;
+    }
+
+    std::filesystem::path SeedPath(uint64_t seed) const
+    {
+        return mDir / ("seed_" + std::to_string(seed) + ".kf");
+    }
+
+    // Each seed has its own file, so workers write without coordinating
+    template <size_t Dim>
+    void Write(uint64_t seed, std::vector<Keyframe<Dim>> const & keyframes) const
+    {
+        std::filesystem::create_directories(mDir);
+        auto path = SeedPath(seed);
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary);
+            out.write("KSKEY3\0", 8);
+            WritePod(out, static_cast<uint32_t>(Dim));
+            WritePod(out, static_cast<uint32_t>(keyframes.empty() ? 0 : keyframes.front().mState.size()));
+            WritePod(out, seed);
+            WritePod(out, static_cast<uint32_t>(mSettings.mThreadsPerSeed));
+            WritePod(out, static_cast<uint32_t>(mSettings.mLoss));
+            WritePod(out, mSettings.mContact);
+            ForEachDescentField(mSettings.mDescent, [&](char const *, auto const & value) {
+                WritePod(out, static_cast<std::conditional_t<std::is_integral_v<std::remove_cvref_t<decltype(value)>>, uint64_t, double>>(value));
+            });
+            WritePod(out, static_cast<uint64_t>(keyframes.size()));
+            for (auto const & keyframe : keyframes)
+            {
+                WritePod(out, static_cast<uint64_t>(keyframe.mEpoch));
+                out.write(reinterpret_cast<char const *>(keyframe.mState.data()), keyframe.mState.size() * sizeof(Vector<Dim>));
+            }
+            out.flush();
+            ASSERT_MSG(out, "could not write {}", tmpPath.string());
+        }
+        std::filesystem::rename(tmpPath, path);
+    }
+
+    // Refuses keyframes written under another loss, contact or descent than this store's
+    template <size_t Dim>
+    SeedKeyframes<Dim> Read(uint64_t seed) const
+    {
+        auto path = SeedPath(seed);
+        std::ifstream in(path, std::ios::binary);
+        ASSERT_MSG(in, "no keyframes for seed at {}", path.string());
+
+        char magic[8];
+        in.read(magic, sizeof(magic));
+        ASSERT_MSG(in && std::string(magic) == "KSKEY3", "{} is not a keyframe file of this version", path.string());
+        auto dim = ReadPod<uint32_t>(in);
+        auto nBalls = ReadPod<uint32_t>(in);
+        ReadPod<uint64_t>(in);
+        SeedKeyframes<Dim> ret;
+        ret.mSettings.mThreadsPerSeed = ReadPod<uint32_t>(in);
+        ret.mSettings.mLoss = static_cast<LossKind>(ReadPod<uint32_t>(in));
+        ret.mSettings.mContact = ReadPod<double>(in);
+        ForEachDescentField(ret.mSettings.mDescent, [&](char const *, auto & value) {
+            using Value = std::remove_cvref_t<decltype(value)>;
+            value = static_cast<Value>(ReadPod<std::conditional_t<std::is_integral_v<Value>, uint64_t, double>>(in));
+        });
+        auto count = ReadPod<uint64_t>(in);
+        ASSERT_MSG(dim == Dim, "{} holds keyframes of another dimension", path.string());
+        ASSERT_MSG(ret.mSettings.SameDescent(mSettings),
+            "{} was written with another loss, contact or --descent - replay with the batch's settings", path.string());
+
+        ret.mKeyframes.resize(count);
+        for (auto & keyframe : ret.mKeyframes)
+        {
+            keyframe.mEpoch = ReadPod<uint64_t>(in);
+            keyframe.mState.resize(nBalls);
+            in.read(reinterpret_cast<char *>(keyframe.mState.data()), nBalls * sizeof(Vector<Dim>));
+        }
+        ASSERT_MSG(in, "{} is truncated", path.string());
+
+        return ret;
+    }
+
+    private:
+    template <typename T>
+    static void WritePod(std::ofstream & out, T value)
+    {
+        out.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static T ReadPod(std::ifstream & in)
+    {
+        T value{};
+        in.read(reinterpret_cast<char *>(&value), sizeof(value));
+        return value;
+    }
+
+    std::filesystem::path mDir;
+    size_t mEpochStride;
+    KeyframeRunSettings mSettings;
+    double mMaxScore;
+};
+
+// The last keyframe at or before epoch
+template <size_t Dim>
+Keyframe<Dim> const & KeyframeBefore(std::vector<Keyframe<Dim>> const & keyframes, size_t epoch)
+{
+    Keyframe<Dim> const * ret = nullptr;
+    for (auto const & keyframe : keyframes)
+    {
+        if (keyframe.mEpoch <= epoch)
+        {
+            ret = &keyframe;
+        }
+    }
+    ASSERT_MSG(ret, "no keyframe at or before epoch {}", epoch);
+    return *ret;
+}
+
+// Frame output that keeps the state opening every EpochStride()th epoch of the current seed and
+// hands them to the store if the seed is kept, then forwards all frames. Does nothing extra
+// without a store.
+template <size_t Dim, typename OutputT>
+class KeyframeRecorder
+{
+    public:
+    KeyframeRecorder(OutputT & inner, KeyframeStore const * store) : mInner(inner), mStore(store)
+    {
+    }
+
+    void StartSeed(uint64_t seed)
+    {
+        mSeed = seed;
+        mKeyframes.clear();
+        mNextFrame = 0;
+    }
+
+    void FinishSeed(double finalScore)
+    {
+        if (mStore && mStore->Keeps(finalScore))
+        {
+            mStore->Write(mSeed, mKeyframes);
+        }
+    }
+
+    void WriteRow(std::vector<Vector<Dim>> const & row)
+    {
+        if (mStore && mNextFrame > 0 && (mNextFrame - 1) % mStore->EpochStride() == 0)
+        {
+            mKeyframes.push_back(Keyframe<Dim>{mNextFrame - 1, row});
+        }
+        mNextFrame++;
+        mInner.WriteRow(row);
+    }
+
+    private:
+    OutputT & mInner;
+    KeyframeStore const * mStore;
+    uint64_t mSeed = 0;
+    std::vector<Keyframe<Dim>> mKeyframes;
+    size_t mNextFrame = 0;
+};
@@ -0,0 +1,100 @@
+#include "python_api.h"
+#include <nanobind/nanobind.h>
+#include <nanobind/ndarray.h>
+#include <nanobind/stl/string.h>
+#include <nanobind/stl/tuple.h>
+#include <nanobind/stl/vector.h>
+
+// Python module "kissing" - see python_api.h. Every call that does real work drops the GIL.
+//
+//   import kissing
+//   points = kissing.initialize(4, 24, seed=12345, init="laminated")
+//   points, score, epochs = kissing.run(points, engine="gd")
+//   results = kissing.run_batch(4, 24, 12345, 12445, threads=8)
+
+namespace nb = nanobind;
+using namespace nb::literals;
+
+using InPoints = nb::ndarray<double const, nb::ndim<2>, nb::c_contig, nb::device::cpu>;
+using OutPoints = nb::ndarray<nb::numpy, double, nb::ndim<2>>;
+using ResultTuple = std::tuple<size_t, double, double, size_t, double, std::string>;
+
+static OutPoints ToNumpy(PointBuffer const & buffer)
+{
+    nb::capsule owner(buffer.mOwner, buffer.mRelease);
+    return OutPoints(buffer.mData, {buffer.mNPoints, buffer.mDim}, owner);
+}
+
+static EngineOptions MakeEngineOptions(std::string const & engine, size_t threadsPerSeed, std::string const & loss, double contact)
+{
+    EngineOptions ret;
+    ret.mKind = ParseEngineKind(engine);
+    ret.mThreadsPerSeed = threadsPerSeed;
+    ret.mLoss = ParseLossKind(loss);
+    ret.mContact = contact;
+    return ret;
+}
+
+static SeedOptions MakeSeedOptions(std::string const & init, double perturbation)
+{
+    SeedOptions ret;
+    ret.mShell = ParseSeedShell(init);
+    ret.mPerturbation = perturbation;
+    return ret;
+}
+
+NB_MODULE(kissing, m)
+{
+    m.doc() = "Kissing configuration search engines";
+
+    m.def("initialize", [](size_t dim, size_t nBalls, uint64_t seed, std::string const & init, double perturbation) {
+        auto seedOptions = MakeSeedOptions(init, perturbation);
+        PointBuffer buffer;
+        {
+            nb::gil_scoped_release release;
+            buffer = InitializePoints(dim, nBalls, seed, seedOptions);
+        }
+        return ToNumpy(buffer);
+    }, "dim"_a, "n_balls"_a, "seed"_a, "init"_a = "random", "perturbation"_a = SeedOptions{}.mPerturbation,
+    "Starting configuration of n_balls unit vectors, as run by the batch mode for this seed");
+
+    m.def("calc_score", [](InPoints points, double contact) {
+        nb::gil_scoped_release release;
+        return ScorePoints(points.data(), points.shape(0), points.shape(1), contact);
+    }, "points"_a, "contact"_a = 0.5, "Total overlap past cos theta contact - 0 for a valid kissing configuration at 0.5");
+
+    m.def("run", [](InPoints points, std::string const & engine, size_t budget, uint64_t seed, size_t threadsPerSeed, std::string const & loss, double contact) {
+        auto engineOptions = MakeEngineOptions(engine, threadsPerSeed, loss, contact);
+        RunOutcome outcome;
+        {
+            nb::gil_scoped_release release;
+            outcome = RunEngine(points.data(), points.shape(0), points.shape(1), engineOptions, seed, budget);
+        }
+        return std::make_tuple(ToNumpy(outcome.mPoints), outcome.mResult.mScore, outcome.mResult.mEpochs);
+    }, "points"_a, "engine"_a = "gd", "budget"_a = 0, "seed"_a = 0, "threads_per_seed"_a = 1, "loss"_a = "reciprocal", "contact"_a = 0.5,
+    "Runs an engine on a copy of points. Returns (points, score, epochs), the score at contact.");
+
+    m.def("run_batch", [](size_t dim, size_t nBalls, size_t firstSeed, size_t lastSeed, std::string const & engine, size_t budget,
+                          std::string const & init, double perturbation, size_t warmStart, size_t threads, std::string const & loss, double contact) {
+        auto engineOptions = MakeEngineOptions(engine, 1, loss, contact);
+        RunOptions options;
+        options.mBudget = budget;
+        options.mSeed = MakeSeedOptions(init, perturbation);
+        options.mWarmStartSteps = warmStart;
+
+        std::vector<WorkResult> results;
+        {
+            nb::gil_scoped_release release;
+            results = RunBatch(dim, nBalls, firstSeed, lastSeed, engineOptions, options, threads);
+        }
+
+        std::vector<ResultTuple> ret;
+        for (auto const & result : results)
+        {
+            ret.emplace_back(result.mSeed, result.mStartScore, result.mScore, result.mEpochs, result.mSeconds, TerminationName(result.mTermination));
+        }
+        return ret;
+    }, "dim"_a, "n_balls"_a, "first_seed"_a, "last_seed"_a, "engine"_a = "gd", "budget"_a = 0,
+    "init"_a = "random", "perturbation"_a = SeedOptions{}.mPerturbation, "warm_start"_a = 0, "threads"_a = 1, "loss"_a = "reciprocal", "contact"_a = 0.5,
+    "Seeds first_seed..last_seed on C++ threads. Returns (seed, start_score, score, epochs, seconds, termination) tuples, as the batch mode prints.");
+}
@@ -0,0 +1,79 @@
+#include "live_stats.h"
+#include <iomanip>
+#include <thread>
+
+// Watches a batch started with --stats <file>.
+// kissing_top <stats_file> [interval_seconds] - interval 0 prints once and exits
+int main(int nargs, char ** argv)
+{
+    ASSERT_MSG(nargs >= 2, "use {} <stats_file> [interval_seconds]", argv[0]);
+    auto stats = LiveStats::Open(argv[1]);
+    double interval = nargs >= 3 ? std::stod(argv[2]) : 1.0;
+
+    auto const & header = stats.Header();
+    auto const & totals = stats.Totals();
+
+    uint64_t lastSeeds = totals.mSeedsCompleted.load(std::memory_order_relaxed);
+    auto lastTime = std::chrono::system_clock::now();
+
+    while (true)
+    {
+        auto now = std::chrono::system_clock::now();
+        auto startTime = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(header.mStartUnixNanos)));
+        std::chrono::duration<double> uptime = now - startTime;
+        std::chrono::duration<double> sinceLast = now - lastTime;
+
+        auto seeds = totals.mSeedsCompleted.load(std::memory_order_relaxed);
+        auto successes = totals.mSuccesses.load(std::memory_order_relaxed);
+        auto epochs = totals.mEpochsCompleted.load(std::memory_order_relaxed);
+        auto best = totals.mBestScore.load(std::memory_order_relaxed);
+
+        auto recentRate = sinceLast.count() > 0 ? (seeds - lastSeeds) / sinceLast.count() : 0;
+        auto averageRate = uptime.count() > 0 ? seeds / uptime.count() : 0;
+
+        if (interval > 0)
+        {
+            // Clear the screen and home the cursor
+            std::cout << "\x1b[2J\x1b[H";
+        }
+
+        std::cout << std::fixed << std::setprecision(2)
+            << header.mDim << "D, " << header.mBalls << " balls, " << header.mNThreads << " threads, up " << uptime.count() << "s\n"
+            << "seeds " << seeds << " (";
+        if (interval > 0)
+        {
+            std::cout << recentRate << "/s now, ";
+        }
+        std::cout << averageRate << "/s average)"
+            << "  successes " << successes
+            << "  best " << std::setprecision(6) << best
+            << "  epochs " << epochs << "\n";
+
+        for (uint32_t threadIdx = 0; threadIdx < header.mNThreads; threadIdx++)
+        {
+            auto const & slot = stats.Thread(threadIdx);
+            auto seed = slot.mSeed.load(std::memory_order_relaxed);
+
+            std::cout << "thread " << std::setw(3) << threadIdx << ": ";
+            if (seed == ThreadStats::Idle)
+            {
+                std::cout << "idle";
+            }
+            else
+            {
+                std::cout << "seed " << seed << " epoch " << slot.mEpoch.load(std::memory_order_relaxed);
+            }
+            std::cout << ", " << slot.mSeedsCompleted.load(std::memory_order_relaxed) << " seeds done\n";
+        }
+        std::cout << std::flush;
+
+        if (interval <= 0)
+        {
+            return 0;
+        }
+
+        lastSeeds = seeds;
+        lastTime = now;
+        std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    }
+}
@@ -0,0 +1,574 @@
+#pragma once
+
+#include "types.h"
+#include "vectors.h"
+#include "initial_states.h"
+#include "debug_output.h"
+#include <bit>
+#include <numbers>
+#include <random>
+#include <string>
+
+// Known good kissing configurations to start from. Every shell is returned as unit vectors.
+// Root systems and the Golay code are built at compile time; anything that needs a square root
+// to change basis (A_n, E6, E7, simplices) or is too large to keep in the binary (Leech) is built
+// once at runtime and cached.
+
+// ---- Compile time tables ----
+
+// D_n roots ±e_i ±e_j: 2n(n-1) points at 60 or 90 degrees - the optimum for n = 3, 4 and 5
+template <size_t Dim>
+consteval std::array<Vector<Dim>, 2 * Dim * (Dim - 1)> DnRoots()
+{
+    constexpr PointType coord = ScaledOne * std::numbers::sqrt2 / 2;
+
+    std::array<Vector<Dim>, 2 * Dim * (Dim - 1)> ret{};
+    size_t idx = 0;
+    for (size_t i = 0; i < Dim; i++)
+    {
+        for (size_t j = i + 1; j < Dim; j++)
+        {
+            for (auto s1 : {-coord, coord})
+            {
+                for (auto s2 : {-coord, coord})
+                {
+                    ret[idx].mValues[i] = s1;
+                    ret[idx].mValues[j] = s2;
+                    idx++;
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+// The 240 E8 roots: D8 plus the half-integer vectors with an even number of minus signs.
+// This is the kissing optimum in 8D.
+consteval std::array<Vector<8>, 240> E8Roots()
+{
+    constexpr PointType half = ScaledOne * std::numbers::sqrt2 / 4;
+
+    std::array<Vector<8>, 240> ret{};
+    auto dn = DnRoots<8>();
+    size_t idx = 0;
+    for (auto const & root : dn)
+    {
+        ret[idx++] = root;
+    }
+
+    for (uint32_t signs = 0; signs < 256; signs++)
+    {
+        if (std::popcount(signs) % 2 != 0)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < 8; i++)
+        {
+            ret[idx].mValues[i] = (signs >> i) & 1 ? -half : half;
+        }
+        idx++;
+    }
+
+    return ret;
+}
+
+// E8 roots orthogonal to every one of the given roots, still in 8D coordinates
+template <size_t NRoots, size_t NConstraints>
+consteval std::array<Vector<8>, NRoots> E8RootsOrthogonalTo(std::array<Vector<8>, NConstraints> constraints)
+{
+    std::array<Vector<8>, NRoots> ret{};
+    size_t idx = 0;
+    for (auto const & root : E8Roots())
+    {
+        bool orthogonal = true;
+        for (auto const & constraint : constraints)
+        {
+            auto dot = Dot(root, constraint);
+            orthogonal &= dot < 1e-9 && dot > -1e-9;
+        }
+
+        if (orthogonal)
+        {
+            ret[idx++] = root;
+        }
+    }
+
+    return ret;
+}
+
+// E7 is the centraliser of the root (1/2, ..., 1/2) - the sum zero hyperplane
+consteval std::array<Vector<8>, 1> E7Constraints()
+{
+    Vector<8> allHalf{};
+    for (auto & coord : allHalf.mValues)
+    {
+        coord = 1;
+    }
+    return {allHalf};
+}
+
+// E6 additionally fixes e7 + e8, which with the above spans an A2
+consteval std::array<Vector<8>, 2> E6Constraints()
+{
+    Vector<8> e78{};
+    e78.mValues[6] = 1;
+    e78.mValues[7] = 1;
+    return {E7Constraints()[0], e78};
+}
+
+// A_n roots e_i - e_j live in the sum zero hyperplane of n+1 dimensions: n(n+1) points.
+// A2 is the hexagon and A3 the cuboctahedron.
+template <size_t Dim>
+consteval std::array<Vector<Dim + 1>, Dim * (Dim + 1)> AnRootsEmbedded()
+{
+    constexpr PointType coord = ScaledOne * std::numbers::sqrt2 / 2;
+
+    std::array<Vector<Dim + 1>, Dim * (Dim + 1)> ret{};
+    size_t idx = 0;
+    for (size_t i = 0; i <= Dim; i++)
+    {
+        for (size_t j = 0; j <= Dim; j++)
+        {
+            if (i != j)
+            {
+                ret[idx].mValues[i] = coord;
+                ret[idx].mValues[j] = -coord;
+                idx++;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Extended binary Golay code: the cyclic [23,12] code generated by x^11+x^10+x^6+x^5+x^4+x^2+1
+// plus an overall parity bit. Codewords are 24 bit masks.
+consteval std::array<uint32_t, 4096> GolayCode()
+{
+    constexpr uint32_t generator = 0b110001110101;
+
+    std::array<uint32_t, 4096> ret{};
+    for (uint32_t message = 0; message < 4096; message++)
+    {
+        uint32_t word = 0;
+        for (size_t bit = 0; bit < 12; bit++)
+        {
+            if ((message >> bit) & 1)
+            {
+                word ^= generator << bit;
+            }
+        }
+
+        word |= static_cast<uint32_t>(std::popcount(word) % 2) << 23;
+        ret[message] = word;
+    }
+
+    return ret;
+}
+
+// Coordinate order for Leech sections: an octad, then the rest of the complement of a second
+// disjoint octad, then that octad. The first 8 coordinates then hold E8 and the first 16
+// Barnes-Wall (the laminated lattices in those dimensions).
+consteval std::array<size_t, 24> LeechCoordinateOrder()
+{
+    auto code = GolayCode();
+    uint32_t first = 0;
+    uint32_t second = 0;
+    for (auto word : code)
+    {
+        if (std::popcount(word) != 8)
+        {
+            continue;
+        }
+
+        if (!first)
+        {
+            first = word;
+        }
+        else if (!second && !(first & word))
+        {
+            second = word;
+        }
+    }
+
+    std::array<size_t, 24> ret{};
+    size_t idx = 0;
+    for (uint32_t mask : {first, ~(first | second) & 0xFFFFFF, second})
+    {
+        for (size_t bit = 0; bit < 24; bit++)
+        {
+            if ((mask >> bit) & 1)
+            {
+                ret[idx++] = bit;
+            }
+        }
+    }
+
+    return ret;
+}
+
+// ---- Runtime shells ----
+
+// Coordinates of points in an orthonormal basis of the complement of the given normals.
+// Used to bring embedded root systems down to their own dimension.
+template <size_t Dim, size_t SourceDim, size_t NPoints, size_t NNormals>
+std::vector<Vector<Dim>> ProjectToComplement(std::array<Vector<SourceDim>, NPoints> const & points, std::array<Vector<SourceDim>, NNormals> const & normals)
+{
+    static_assert(Dim + NNormals == SourceDim);
+
+    std::vector<Vector<SourceDim>> basis;
+    for (auto normal : normals)
+    {
+        for (auto const & vec : basis)
+        {
+            Residualize(normal, vec);
+        }
+        Normalize(normal, ScaledOne);
+        basis.push_back(normal);
+    }
+
+    for (size_t axis = 0; axis < SourceDim && basis.size() < SourceDim; axis++)
+    {
+        Vector<SourceDim> candidate{};
+        candidate.mValues[axis] = ScaledOne;
+        for (auto const & vec : basis)
+        {
+            Residualize(candidate, vec);
+        }
+
+        if (Dot(candidate, candidate) > 1e-6)
+        {
+            Normalize(candidate, ScaledOne);
+            basis.push_back(candidate);
+        }
+    }
+
+    std::vector<Vector<Dim>> ret;
+    for (auto const & point : points)
+    {
+        auto & projected = ret.emplace_back();
+        for (size_t i = 0; i < Dim; i++)
+        {
+            projected.mValues[i] = Dot(point, basis[NNormals + i]);
+        }
+        Normalize(projected, ScaledOne);
+    }
+
+    return ret;
+}
+
+template <size_t Dim>
+std::vector<Vector<Dim>> CrossPolytope()
+{
+    std::vector<Vector<Dim>> ret;
+    for (size_t i = 0; i < Dim; i++)
+    {
+        for (auto sign : {-ScaledOne, ScaledOne})
+        {
+            auto & vec = ret.emplace_back();
+            vec.Zero();
+            vec.mValues[i] = sign;
+        }
+    }
+
+    return ret;
+}
+
+// A regular simplex and its antipodes: 2(Dim+1) points, no pair closer than arccos(1/Dim)
+template <size_t Dim>
+std::vector<Vector<Dim>> DoubleSimplex()
+{
+    std::array<Vector<Dim + 1>, Dim + 1> embedded{};
+    for (size_t i = 0; i <= Dim; i++)
+    {
+        embedded[i].mValues[i] = ScaledOne;
+    }
+
+    Vector<Dim + 1> allOnes{};
+    for (auto & coord : allOnes.mValues)
+    {
+        coord = ScaledOne;
+    }
+
+    auto simplex = ProjectToComplement<Dim>(embedded, std::array<Vector<Dim + 1>, 1>{allOnes});
+    auto ret = simplex;
+    for (auto vec : simplex)
+    {
+        for (auto & coord : vec.mValues)
+        {
+            coord = -coord;
+        }
+        ret.push_back(vec);
+    }
+
+    return ret;
+}
+
+// Minimal vectors of the Leech lattice lying in its first Dim coordinates (in LeechCoordinateOrder).
+// Dim = 24 is all 196560, 16 the 4320 of Barnes-Wall and 8 the 240 of E8; in between it is a
+// valid but not necessarily optimal configuration.
+template <size_t Dim>
+std::vector<Vector<Dim>> LeechSection()
+{
+    static_assert(Dim <= 24);
+    constexpr auto code = GolayCode();
+    constexpr auto order = LeechCoordinateOrder();
+    // Minimal vectors have norm 32 in the usual sqrt(8) scaling
+    constexpr PointType unit = ScaledOne / (4 * std::numbers::sqrt2);
+
+    std::array<size_t, 24> position{};
+    uint32_t sectionMask = 0;
+    for (size_t i = 0; i < 24; i++)
+    {
+        position[order[i]] = i;
+        if (i < Dim)
+        {
+            sectionMask |= 1u << order[i];
+        }
+    }
+
+    std::vector<Vector<Dim>> ret;
+    auto setCoord = [&](Vector<Dim> & vec, size_t bit, PointType value) { vec.mValues[position[bit]] = value * unit; };
+
+    // (±2^8 0^16) on an octad with an even number of minus signs
+    for (auto word : code)
+    {
+        if (std::popcount(word) != 8 || (word & ~sectionMask))
+        {
+            continue;
+        }
+
+        for (uint32_t signs = 0; signs < 256; signs++)
+        {
+            if (std::popcount(signs) % 2 != 0)
+            {
+                continue;
+            }
+
+            auto & vec = ret.emplace_back();
+            vec.Zero();
+            size_t signBit = 0;
+            for (size_t bit = 0; bit < 24; bit++)
+            {
+                if ((word >> bit) & 1)
+                {
+                    setCoord(vec, bit, (signs >> signBit++) & 1 ? -2 : 2);
+                }
+            }
+        }
+    }
+
+    // (±4 ±4 0^22)
+    for (size_t i = 0; i < 24; i++)
+    {
+        for (size_t j = i + 1; j < 24; j++)
+        {
+            if (!((sectionMask >> i) & 1) || !((sectionMask >> j) & 1))
+            {
+                continue;
+            }
+
+            for (PointType s1 : {-4, 4})
+            {
+                for (PointType s2 : {-4, 4})
+                {
+                    auto & vec = ret.emplace_back();
+                    vec.Zero();
+                    setCoord(vec, i, s1);
+                    setCoord(vec, j, s2);
+                }
+            }
+        }
+    }
+
+    // (-3 1^23) with signs flipped on a codeword - full support, so only in the full lattice
+    if constexpr (Dim == 24)
+    {
+        for (auto word : code)
+        {
+            for (size_t k = 0; k < 24; k++)
+            {
+                auto & vec = ret.emplace_back();
+                for (size_t bit = 0; bit < 24; bit++)
+                {
+                    PointType sign = (word >> bit) & 1 ? -1 : 1;
+                    setCoord(vec, bit, bit == k ? -3 * sign : sign);
+                }
+            }
+        }
+    }
+
+    return ret;
+}
+
+template <size_t Dim, size_t N>
+std::vector<Vector<Dim>> ToVector(std::array<Vector<Dim>, N> const & points)
+{
+    return std::vector<Vector<Dim>>(points.begin(), points.end());
+}
+
+// Root system of the densest lattice packing known in this dimension, which for Dim <= 8 is
+// the laminated lattice's minimal shell. Beyond that fall back to sections of the Leech lattice.
+template <size_t Dim>
+std::vector<Vector<Dim>> LaminatedShell()
+{
+    if constexpr (Dim == 1)
+    {
+        return CrossPolytope<1>();
+    }
+    else if constexpr (Dim == 2 || Dim == 3)
+    {
+        return ProjectToComplement<Dim>(AnRootsEmbedded<Dim>(), std::array<Vector<Dim + 1>, 1>{[]{
+            Vector<Dim + 1> allOnes{};
+            for (auto & coord : allOnes.mValues) { coord = ScaledOne; }
+            return allOnes;
+        }()});
+    }
+    else if constexpr (Dim == 4 || Dim == 5)
+    {
+        return ToVector(DnRoots<Dim>());
+    }
+    else if constexpr (Dim == 6)
+    {
+        return ProjectToComplement<6>(E8RootsOrthogonalTo<72>(E6Constraints()), E6Constraints());
+    }
+    else if constexpr (Dim == 7)
+    {
+        return ProjectToComplement<7>(E8RootsOrthogonalTo<126>(E7Constraints()), E7Constraints());
+    }
+    else if constexpr (Dim == 8)
+    {
+        return ToVector(E8Roots());
+    }
+    else
+    {
+        return LeechSection<Dim>();
+    }
+}
+
+enum class SeedShell
+{
+    Random,
+    // Best known shell for the dimension (LaminatedShell)
+    Laminated,
+    Dn,
+    CrossPolytope,
+    DoubleSimplex,
+};
+
+inline SeedShell ParseSeedShell(std::string const & name)
+{
+    if (name == "random") { return SeedShell::Random; }
+    if (name == "laminated") { return SeedShell::Laminated; }
+    if (name == "dn") { return SeedShell::Dn; }
+    if (name == "cross") { return SeedShell::CrossPolytope; }
+    if (name == "simplex") { return SeedShell::DoubleSimplex; }
+
+    ASSERT_MSG(false, "unknown seed shell {} - choose one of random, laminated, dn, cross, simplex", name);
+    return SeedShell::Random;
+}
+
+// Shells are built once per process and shared read only between workers
+template <size_t Dim>
+std::vector<Vector<Dim>> const & CachedShell(SeedShell shell)
+{
+    switch (shell)
+    {
+        case SeedShell::Laminated:
+        {
+            static auto const ret = LaminatedShell<Dim>();
+            return ret;
+        }
+        case SeedShell::Dn:
+        {
+            static auto const ret = [] {
+                if constexpr (Dim >= 2) { return ToVector(DnRoots<Dim>()); }
+                else { return CrossPolytope<Dim>(); }
+            }();
+            return ret;
+        }
+        case SeedShell::CrossPolytope:
+        {
+            static auto const ret = CrossPolytope<Dim>();
+            return ret;
+        }
+        case SeedShell::DoubleSimplex:
+        {
+            static auto const ret = DoubleSimplex<Dim>();
+            return ret;
+        }
+        case SeedShell::Random:
+            break;
+    }
+
+    static std::vector<Vector<Dim>> const empty;
+    return empty;
+}
+
+// nBalls points from the shell in a random orientation. Below the shell size a random subset is
+// taken, above it the remainder is random. perturbation is the stddev of Gaussian noise added to
+// every point before renormalising.
+template <size_t Dim, typename Rand>
+std::vector<Vector<Dim>> InitializeFromShell(std::vector<Vector<Dim>> const & shell, size_t nBalls, PointType perturbation, Rand & rand)
+{
+    std::vector<size_t> indices(shell.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        indices[i] = i;
+    }
+
+    auto nFromShell = std::min(nBalls, shell.size());
+    for (size_t i = 0; i < nFromShell; i++)
+    {
+        std::uniform_int_distribution<size_t> pick(i, indices.size() - 1);
+        std::swap(indices[i], indices[pick(rand)]);
+    }
+
+    auto orientation = RandomOrientation<Dim>(rand);
+    std::normal_distribution<double> gauss(0, 1.0);
+
+    std::vector<Vector<Dim>> ret;
+    for (size_t i = 0; i < nBalls; i++)
+    {
+        Vector<Dim> point;
+        if (i < nFromShell)
+        {
+            point = orientation.Multiply(shell[indices[i]]);
+        }
+        else
+        {
+            for (auto & coord : point.mValues)
+            {
+                coord = DrawGaussian(rand, gauss);
+            }
+        }
+
+        for (auto & coord : point.mValues)
+        {
+            coord += DrawGaussian(rand, gauss) * perturbation;
+        }
+        Normalize(point, ScaledOne);
+        ret.push_back(point);
+    }
+
+    return ret;
+}
+
+struct SeedOptions
+{
+    SeedShell mShell = SeedShell::Random;
+    PointType mPerturbation = ScaledOne / 20;
+};
+
+template <size_t Dim, typename Rand>
+std::vector<Vector<Dim>> InitializeSeed(SeedOptions const & options, size_t nBalls, Rand & rand)
+{
+    if (options.mShell == SeedShell::Random)
+    {
+        return Initialize<Dim>(nBalls, ScaledOne, rand);
+    }
+
+    return InitializeFromShell(CachedShell<Dim>(options.mShell), nBalls, options.mPerturbation, rand);
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "types.h"
+#include "debug_output.h"
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Live progress of a batch, published through a memory mapped file for kissing_top to read.
+// Workers only ever do relaxed stores into their own cache line, so watching a run costs it
+// nothing. The file is laid out as a header, the run totals, then one slot per worker thread.
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<double>::is_always_lock_free,
+    "stats are shared between processes so need address free atomics");
+
+struct alignas(64) StatsHeader
+{
+    static constexpr uint64_t Magic = 0x5354415453534B4Bull;
+    static constexpr uint32_t Version = 1;
+
+    uint64_t mMagic;
+    uint32_t mVersion;
+    uint32_t mNThreads;
+    uint32_t mDim;
+    uint32_t mBalls;
+    int64_t mStartUnixNanos;
+};
+
+// Written by the thread collecting results
+struct alignas(64) StatsTotals
+{
+    std::atomic<uint64_t> mSeedsCompleted;
+    std::atomic<uint64_t> mSuccesses;
+    std::atomic<uint64_t> mEpochsCompleted;
+    std::atomic<double> mBestScore;
+};
+
+// Written by one worker thread
+struct alignas(64) ThreadStats
+{
+    static constexpr uint64_t Idle = std::numeric_limits<uint64_t>::max();
+
+    std::atomic<uint64_t> mSeed;
+    std::atomic<uint64_t> mEpoch;
+    std::atomic<uint64_t> mSeedsCompleted;
+};
+
+class LiveStats
+{
+    public:
+    static LiveStats Create(std::string const & path, uint32_t nThreads, uint32_t dim, uint32_t balls)
+    {
+        auto fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ASSERT_MSG(fd >= 0, "could not create stats file {}", path);
+
+        auto size = FileSize(nThreads);
+        ASSERT_MSG(ftruncate(fd, static_cast<off_t>(size)) == 0, "could not size stats file {}", path);
+        auto * mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        ASSERT_MSG(mapping != MAP_FAILED, "could not map stats file {}", path);
+
+        LiveStats ret(static_cast<std::byte *>(mapping), size);
+        for (uint32_t threadIdx = 0; threadIdx < nThreads; threadIdx++)
+        {
+            auto & slot = ret.Thread(threadIdx);
+            slot.mSeed.store(ThreadStats::Idle, std::memory_order_relaxed);
+        }
+        ret.Totals().mBestScore.store(std::numeric_limits<double>::infinity(), std::memory_order_relaxed);
+
+        // The header goes last so a reader never sees a valid magic over unset slots
+        auto & header = *reinterpret_cast<StatsHeader *>(ret.mMapping);
+        header.mVersion = StatsHeader::Version;
+        header.mNThreads = nThreads;
+        header.mDim = dim;
+        header.mBalls = balls;
+        header.mStartUnixNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        std::atomic_thread_fence(std::memory_order_release);
+        header.mMagic = StatsHeader::Magic;
+
+        return ret;
+    }
+
+    static LiveStats Open(std::string const & path)
+    {
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        ASSERT_MSG(fd >= 0, "could not open stats file {}", path);
+
+        auto size = static_cast<size_t>(lseek(fd, 0, SEEK_END));
+        ASSERT_MSG(size >= FileSize(0), "{} is too small to be a stats file", path);
+        auto * mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        ASSERT_MSG(mapping != MAP_FAILED, "could not map stats file {}", path);
+
+        LiveStats ret(static_cast<std::byte *>(mapping), size);
+        auto const & header = ret.Header();
+        ASSERT_MSG(header.mMagic == StatsHeader::Magic && header.mVersion == StatsHeader::Version, "{} is not a stats file", path);
+        ASSERT_MSG(size >= FileSize(header.mNThreads), "{} is truncated", path);
+        return ret;
+    }
+
+    LiveStats(LiveStats && other) : mMapping(other.mMapping), mSize(other.mSize)
+    {
+        other.mMapping = nullptr;
+    }
+
+    LiveStats(LiveStats const &) = delete;
+    LiveStats & operator=(LiveStats const &) = delete;
+
+    ~LiveStats()
+    {
+        if (mMapping)
+        {
+            munmap(mMapping, mSize);
+        }
+    }
+
+    StatsHeader const & Header() const
+    {
+        return *reinterpret_cast<StatsHeader const *>(mMapping);
+    }
+
+    StatsTotals & Totals() const
+    {
+        return *reinterpret_cast<StatsTotals *>(mMapping + sizeof(StatsHeader));
+    }
+
+    ThreadStats & Thread(size_t threadIdx) const
+    {
+        return reinterpret_cast<ThreadStats *>(mMapping + sizeof(StatsHeader) + sizeof(StatsTotals))[threadIdx];
+    }
+
+    // Called by the result collector once per finished seed
+    void RecordResult(double score, uint64_t epochs) const
+    {
+        auto & totals = Totals();
+        totals.mSeedsCompleted.store(totals.mSeedsCompleted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        totals.mSuccesses.store(totals.mSuccesses.load(std::memory_order_relaxed) + (score == 0), std::memory_order_relaxed);
+        totals.mEpochsCompleted.store(totals.mEpochsCompleted.load(std::memory_order_relaxed) + epochs, std::memory_order_relaxed);
+        if (score < totals.mBestScore.load(std::memory_order_relaxed))
+        {
+            totals.mBestScore.store(score, std::memory_order_relaxed);
+        }
+    }
+
+    private:
+    LiveStats(std::byte * mapping, size_t size) : mMapping(mapping), mSize(size)
+    {
+    }
+
+    static size_t FileSize(size_t nThreads)
+    {
+        return sizeof(StatsHeader) + sizeof(StatsTotals) + nThreads * sizeof(ThreadStats);
+    }
+
+    std::byte * mMapping;
+    size_t mSize;
+};
+
+// Frame output that counts frames - one per outer epoch or round in every engine - into a
+// worker's slot, then forwards them
+template <typename OutputT>
+class ProgressOutput
+{
+    public:
+    ProgressOutput(OutputT & inner, ThreadStats * stats) : mInner(inner), mStats(stats)
+    {
+    }
+
+    void StartSeed(uint64_t seed)
+    {
+        mFrames = 0;
+        if (mStats)
+        {
+            mStats->mSeed.store(seed, std::memory_order_relaxed);
+            mStats->mEpoch.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void FinishSeed()
+    {
+        if (mStats)
+        {
+            mStats->mSeedsCompleted.store(mStats->mSeedsCompleted.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    void Finish()
+    {
+        if (mStats)
+        {
+            mStats->mSeed.store(ThreadStats::Idle, std::memory_order_relaxed);
+        }
+    }
+
+    template <size_t Dim>
+    void WriteRow(std::vector<Vector<Dim>> const & row)
+    {
+        if (mStats)
+        {
+            mStats->mEpoch.store(++mFrames, std::memory_order_relaxed);
+        }
+        mInner.WriteRow(row);
+    }
+
+    private:
+    OutputT & mInner;
+    ThreadStats * mStats;
+    uint64_t mFrames = 0;
+};
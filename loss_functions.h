@@ -0,0 +1,103 @@
+#pragma once
+
+#include "fast_math.h"
+#include "debug_output.h"
+#include <algorithm>
+#include <string>
+
+// Loss policies for the descent. Each maps the cos theta of a pair over the threshold to the
+// weight of its push. They are plain arithmetic (FastExp / FastLog rather than the library
+// calls), so the pair kernel's weight loop vectorises whichever is in use.
+// Policies are selected at runtime by WithLoss, which instantiates the descent once per policy.
+
+// Smallest 1 - cos theta the clamped losses weigh a pair at
+static constexpr double LossClamp = 0.01;
+
+// The original: grows as the pair closes, capped at 1 / mClamp
+struct ReciprocalLoss
+{
+    double mClamp = LossClamp;
+
+    double operator()(double cos_theta) const
+    {
+        return 1 / std::max(mClamp, (1 - cos_theta));
+    }
+};
+
+// Sharper than reciprocal near the threshold, gentler at large overlaps
+struct ExponentialLoss
+{
+    static constexpr double Sharpness = 5;
+
+    double operator()(double cos_theta) const
+    {
+        return FastExp(Sharpness * (cos_theta - 0.5));
+    }
+};
+
+// (1 + Stiffness * overlap)^2 - quadratic in the overlap past 0.5
+struct PolyHingeLoss
+{
+    static constexpr double Stiffness = 20;
+
+    double operator()(double cos_theta) const
+    {
+        auto hinge = 1 + Stiffness * std::max(0.0, cos_theta - 0.5);
+        return hinge * hinge;
+    }
+};
+
+// 1 - log((1 - cos theta) / 0.5): 1 at the threshold, growing only logarithmically
+struct LogBarrierLoss
+{
+    double mClamp = LossClamp;
+
+    double operator()(double cos_theta) const
+    {
+        return 1 - FastLog(std::max(mClamp, (1 - cos_theta)) * 2);
+    }
+};
+
+enum class LossKind
+{
+    Reciprocal,
+    Exponential,
+    PolyHinge,
+    LogBarrier,
+};
+
+inline LossKind ParseLossKind(std::string const & name)
+{
+    if (name == "reciprocal") { return LossKind::Reciprocal; }
+    if (name == "exp") { return LossKind::Exponential; }
+    if (name == "polyhinge") { return LossKind::PolyHinge; }
+    if (name == "logbarrier") { return LossKind::LogBarrier; }
+
+    ASSERT_MSG(false, "unknown loss {} - choose one of reciprocal, exp, polyhinge, logbarrier", name);
+    return LossKind::Reciprocal;
+}
+
+inline char const * LossName(LossKind kind)
+{
+    switch (kind)
+    {
+        case LossKind::Reciprocal: return "reciprocal";
+        case LossKind::Exponential: return "exp";
+        case LossKind::PolyHinge: return "polyhinge";
+        case LossKind::LogBarrier: return "logbarrier";
+    }
+    return "";
+}
+
+// Calls func with the policy for kind, clamped at clamp if it is a clamped loss
+template <typename Func>
+void WithLoss(LossKind kind, Func && func, double clamp = LossClamp)
+{
+    switch (kind)
+    {
+        case LossKind::Reciprocal: func(ReciprocalLoss{clamp}); return;
+        case LossKind::Exponential: func(ExponentialLoss{}); return;
+        case LossKind::PolyHinge: func(PolyHingeLoss{}); return;
+        case LossKind::LogBarrier: func(LogBarrierLoss{clamp}); return;
+    }
+}
@@ -1,15 +1,19 @@
 
-#include "force_approach.h"
-#include "simulated_annealing.h"
-#include "dot_gradient_descent.h"
+#include "deep_holes.h"
+#include "engines.h"
+#include "keyframes.h"
+#include "options.h"
+#include "seed_runner.h"
 #include "thread_safe_queue.h"
-
-struct WorkResult
-{
-    size_t mSeed;
-    double mStartScore;
-    double mScore;
-};
+#include "work_result.h"
+#include "shard_ledger.h"
+#include "live_stats.h"
+#include "trajectory_export.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <numbers>
+#include <sstream>
 
 // static constexpr size_t DIMENSION = 2; static constexpr size_t targetBalls = 6;
 // static constexpr size_t DIMENSION = 3; static constexpr size_t targetBalls = 12;
@@ -17,102 +21,536 @@ static constexpr size_t DIMENSION = 4; static constexpr size_t targetBalls = 24;
 // static constexpr size_t DIMENSION = 5; static constexpr size_t targetBalls = 40;
 // static constexpr size_t DIMENSION = 11; static constexpr size_t targetBalls = 593;
 
-template <typename OutputT>
-void workerThread(std::atomic<size_t> & inputQueue, ThreadSafeQueue<WorkResult> & resultQueue, OutputT & output, size_t finishNumber)
+// Optional places a run reports to besides its result lines
+struct RunSinks
+{
+    LiveStats const * mLiveStats = nullptr;
+    TrajectoryExporter * mExporter = nullptr;
+    KeyframeStore const * mKeyframes = nullptr;
+};
+
+template <typename EngineT, typename OutputT>
+    requires Engine<EngineT, DIMENSION, Philox4x32, ProgressOutput<TrajectoryRecorder<DIMENSION, KeyframeRecorder<DIMENSION, OutputT>>>>
+void workerThread(EngineT const & engine, RunOptions const & options, std::atomic<size_t> & inputQueue, ThreadSafeQueue<WorkResult> & resultQueue, OutputT & output, size_t finishNumber, ThreadStats * stats, RunSinks const & sinks)
 {
+    KeyframeRecorder<DIMENSION, OutputT> keyframer(output, sinks.mKeyframes);
+    TrajectoryRecorder<DIMENSION, KeyframeRecorder<DIMENSION, OutputT>> recorder(keyframer, sinks.mExporter, options.mLoss, EngineDescent(engine), EngineContact(engine));
+    ProgressOutput<TrajectoryRecorder<DIMENSION, KeyframeRecorder<DIMENSION, OutputT>>> progress(recorder, stats);
     while(true)
     {
         size_t seed = inputQueue++;
         if (seed > finishNumber)
         {
+            progress.Finish();
             resultQueue.MarkFinishedProducer();
             return;
         }
 
-        std::mt19937 rand(seed);
-        auto state = Initialize<DIMENSION>(targetBalls, ScaledOne, rand);
+        progress.StartSeed(seed);
+        recorder.StartSeed(seed);
+        keyframer.StartSeed(seed);
+        std::vector<Vector<DIMENSION>> state;
+        auto result = RunSeed<DIMENSION>(engine, options, seed, targetBalls, progress, state);
+        recorder.FinishSeed(state, result.mScore);
+        keyframer.FinishSeed(result.mScore);
+        progress.FinishSeed();
+        resultQueue.Push(std::move(result));
+    }
+}
+
+
+
+// Runs firstSeed..lastSeed across nThreads workers, printing each result to resultOut as it
+// arrives
+template <typename OutputT>
+std::vector<WorkResult> RunSeeds(EngineOptions const & engineOptions, RunOptions const & options, size_t firstSeed, size_t lastSeed, size_t nThreads, OutputT & output, std::ostream & resultOut, RunSinks const & sinks)
+{
+    std::atomic<size_t> nextSeed{firstSeed};
+    ThreadSafeQueue<WorkResult> results{nThreads};
+    std::vector<std::thread> threads;
+    std::vector<WorkResult> allResults;
+
+    WithEngine(engineOptions, [&](auto const & engine) {
+        for (size_t i = 0; i < nThreads; i++)
+        {
+            auto * stats = sinks.mLiveStats ? &sinks.mLiveStats->Thread(i) : nullptr;
+            threads.emplace_back([&, stats]{ return workerThread(engine, options, nextSeed, results, output, lastSeed, stats, sinks);});
+        }
+
+        while (true)
+        {
+            auto entry = results.PopWait();
+            if (!entry.has_value())
+            {
+                break;
+            }
+
+            PrintResult(*entry, resultOut);
+            allResults.push_back(*entry);
+            if (sinks.mLiveStats)
+            {
+                sinks.mLiveStats->RecordResult(entry->mScore, entry->mEpochs);
+            }
+        }
+
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+    });
+
+    return allResults;
+}
+
+// Claims shards from the ledger until none are left, writing each shard's results to its own
+// file in resultsDir
+void RunShards(EngineOptions const & engineOptions, RunOptions const & options, std::string const & ledgerPath, std::filesystem::path const & resultsDir, size_t nThreads, RunSinks const & sinks)
+{
+    ShardLedger ledger(ledgerPath);
+    auto owner = ShardLedger::ProcessOwner();
+    std::filesystem::create_directories(resultsDir);
+    NoOutput noOutput;
+    std::vector<WorkResult> allResults;
+
+    while (auto shard = ledger.Claim(owner))
+    {
+        std::cerr << "Worker " << owner << " running seeds " << shard->mFirstSeed << ".." << shard->mLastSeed << std::endl;
+
+        auto finalPath = ShardResultsPath(resultsDir, *shard);
+        auto tmpPath = finalPath;
+        tmpPath += ".tmp." + std::to_string(getpid());
+
+        {
+            // Renews well before the lease runs out - a lost lease only costs the shard being run twice
+            LeaseHeartbeat heartbeat(ledgerPath, *shard, owner, ledger.LeaseSeconds());
+            std::ofstream shardOut(tmpPath);
+            auto results = RunSeeds(engineOptions, options, shard->mFirstSeed, shard->mLastSeed, nThreads, noOutput, shardOut, sinks);
+            allResults.insert(allResults.end(), results.begin(), results.end());
+            shardOut.flush();
+            ASSERT_MSG(shardOut, "could not write {}", tmpPath.string());
+        }
+
+        std::filesystem::rename(tmpPath, finalPath);
+        ledger.Complete(*shard, owner);
+    }
+
+    PrintSummary(allResults, std::cerr);
+}
+
+// Grows a configuration a ball at a time. A cold start at startBalls (retrying with the next
+// seeds if it fails), then each rung drops a ball into the deepest hole of the last valid
+// configuration and re-runs the engine from there, trying the next deepest hole on failure.
+// Prints a (balls, attempt, score, epochs, seconds, termination) line per run and writes every
+// valid configuration to validOutput. Returns the largest valid ball count, 0 if none.
+template <typename OutputT>
+size_t RunRamp(EngineOptions const & engineOptions, RunOptions const & options, size_t seed, size_t startBalls, OutputT & validOutput)
+{
+    static constexpr size_t StartAttempts = 16;
+    std::vector<Vector<DIMENSION>> valid;
 
-        // auto state = Initialize4D(rand);
-        ASSERT(state.size() == targetBalls);
-        Normalize(state, ScaledOne);
+    WithEngine(engineOptions, [&](auto const & engine) {
+        NoOutput noOutput;
+        std::vector<Vector<DIMENSION>> state;
+        auto printRun = [&](size_t attempt, WorkResult const & result) {
+            std::cout << "(" << state.size() << "," << attempt << "," << result.mScore << "," << result.mEpochs << "," << result.mSeconds
+                << ",\"" << TerminationName(result.mTermination) << "\")," << std::endl;
+        };
 
-        auto neighbourLookup = ConstructPointNeighbours(state);
-        auto startScore = CalcScore(state, neighbourLookup);
+        for (size_t attempt = 0; attempt < StartAttempts && valid.empty(); attempt++)
+        {
+            auto result = RunSeed<DIMENSION>(engine, options, seed + attempt, startBalls, noOutput, state);
+            printRun(attempt, result);
+            if (result.mScore == 0)
+            {
+                valid = state;
+                validOutput.WriteRow(valid);
+            }
+        }
 
-        auto score = RunGradientDescent<DIMENSION>(state, output);
+        auto rand = Philox4x32(seed).Stream(1);
+        while (!valid.empty() && (options.mMaxBalls == 0 || valid.size() < options.mMaxBalls))
+        {
+            bool grown = false;
+            auto holes = FindDeepHoles(valid, rand, options.mHoleAttempts);
+            for (size_t attempt = 0; attempt < holes.size() && !grown; attempt++)
+            {
+                auto startTime = std::chrono::steady_clock::now();
+                state = valid;
+                auto & ball = state.emplace_back(holes[attempt].mCentre);
+                Normalize(ball, ScaledOne);
 
+                auto engineResult = engine.template Run<DIMENSION>(state, rand, noOutput, options.mBudget);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+                printRun(attempt, WorkResult{seed, 0, engineResult.mScore, engineResult.mEpochs, elapsed.count(), engineResult.mTermination});
 
-        resultQueue.Push(WorkResult{seed, startScore, score});
+                if (engineResult.mScore == 0)
+                {
+                    valid = state;
+                    validOutput.WriteRow(valid);
+                    grown = true;
+                }
+            }
+
+            if (!grown)
+            {
+                break;
+            }
+        }
+    });
+
+    return valid.size();
+}
+
+// Largest cos theta between any two of the points, i.e. the cosine of their minimum angle
+double MaxPairCos(std::vector<Vector<DIMENSION>> state)
+{
+    Normalize(state, 1);
+    double ret = -1;
+    for (PointId pointId = 0; pointId < state.size(); pointId++)
+    {
+        for (PointId otherId = pointId + 1; otherId < state.size(); otherId++)
+        {
+            ret = std::max(ret, Dot(state[pointId], state[otherId]));
+        }
     }
+    return ret;
 }
 
+// Best minimum angle for nBalls points: bisects on the contact cos theta, warm starting every
+// probe from the best configuration so far. Any configuration is valid at its own largest cos,
+// so a probe that succeeds lowers the upper bound to what it actually reached, and one that fails
+// raises the lower bound to the contact it was asked for. Starts from a cold run at
+// options.mContact, and brackets 0.1 below if that succeeds. Prints a (probe, contact, score,
+// epochs, seconds, termination) line per probe and returns the best configuration.
+std::vector<Vector<DIMENSION>> RunMaxMin(EngineOptions engineOptions, RunOptions const & options, size_t seed, size_t nBalls)
+{
+    static constexpr double BracketWidth = 0.1;
+    static constexpr double Tolerance = 1e-7;
+    NoOutput noOutput;
+    std::vector<Vector<DIMENSION>> state;
+    auto printProbe = [&](size_t probe, double contact, WorkResult const & result) {
+        std::cout << "(" << probe << "," << contact << "," << result.mScore << "," << result.mEpochs << "," << result.mSeconds
+            << ",\"" << TerminationName(result.mTermination) << "\")," << std::endl;
+    };
+
+    engineOptions.mContact = options.mContact;
+    WorkResult cold;
+    WithEngine(engineOptions, [&](auto const & engine) {
+        cold = RunSeed<DIMENSION>(engine, options, seed, nBalls, noOutput, state);
+    });
+    printProbe(0, options.mContact, cold);
+
+    auto best = state;
+    auto hi = MaxPairCos(best);
+    auto lo = cold.mScore == 0 ? std::max(-1.0, hi - BracketWidth) : options.mContact;
+
+    auto rand = Philox4x32(seed).Stream(2);
+    for (size_t probe = 1; probe <= options.mBisectSteps && hi - lo > Tolerance; probe++)
+    {
+        auto contact = (lo + hi) / 2;
+        engineOptions.mContact = contact;
+        state = best;
+        auto startTime = std::chrono::steady_clock::now();
+        EngineResult result;
+        WithEngine(engineOptions, [&](auto const & engine) {
+            result = engine.template Run<DIMENSION>(state, rand, noOutput, options.mBudget);
+        });
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        printProbe(probe, contact, WorkResult{seed, 0, result.mScore, result.mEpochs, elapsed.count(), result.mTermination});
+
+        if (result.mScore == 0)
+        {
+            best = state;
+            hi = std::min(contact, MaxPairCos(best));
+        }
+        else
+        {
+            lo = contact;
+        }
+    }
 
+    return best;
+}
+
+// Runs seed with the engine and classifies the contact graph it ends on
+void PrintRigidity(EngineOptions const & engineOptions, RunOptions const & options, size_t seed, size_t nBalls)
+{
+    NoOutput noOutput;
+    std::vector<Vector<DIMENSION>> state;
+    WorkResult result;
+    WithEngine(engineOptions, [&](auto const & engine) {
+        result = RunSeed<DIMENSION>(engine, options, seed, nBalls, noOutput, state);
+    });
+    PrintResult(result, std::cout);
+
+    auto neighbourLookup = ConstructPointNeighbours(state, NeighbourMarginFor(options.mContact));
+    auto report = AnalyseRigidity(state, neighbourLookup, options.mContact, options.mRigidity);
+    if (!report.mAnalysed)
+    {
+        std::cerr << "Contacts " << report.mContacts << ", rattlers " << report.mRattlers << ": not analysed, over the size limit" << std::endl;
+        return;
+    }
+    std::cerr << "Contacts " << report.mContacts << ", rattlers " << report.mRattlers << ", rank " << report.mRank
+        << ", flexes " << report.mFlexes << ": " << (report.Jammed() ? "rigid" : "flexible") << std::endl;
+}
+
+// Tunes the descent's constants for this build's dimension and ball count on the seeds from
+// options.mFirstSeed, and writes the winner to path for --descent
+void RunTune(EngineOptions engineOptions, RunOptions const & options, size_t nThreads, std::string const & path)
+{
+    NoOutput noOutput;
+    std::ostream noResults(nullptr);
+    auto evaluate = [&](DescentParams const & descent, size_t first, size_t last) {
+        engineOptions.mDescent = descent;
+        return RunSeeds(engineOptions, options, options.mFirstSeed + first, options.mFirstSeed + last, nThreads, noOutput, noResults, RunSinks{});
+    };
+    auto best = TuneDescent(engineOptions.mDescent, options.mTune, evaluate, std::cerr);
+
+    std::ostringstream comment;
+    comment << "tuned on seeds " << options.mFirstSeed << ".." << options.mFirstSeed + best.mSeeds - 1 << ": " << best.mSuccesses
+        << " successes, " << best.SuccessesPerSecond() << " per CPU second, mean score " << best.MeanScore();
+    WriteDescentParams(path, best.mParams, DIMENSION, targetBalls, comment.str());
+    std::cerr << "Wrote " << path << " (" << comment.str() << ")" << std::endl;
+}
+
+// Restores the last keyframe of seed at or before options.mFromEpoch and runs the descent on
+// from there, writing frames from the keyframe on. Only the gradient descent can resume.
+template <typename OutputT>
+WorkResult ReplaySeed(EngineOptions const & engineOptions, RunOptions const & options, size_t seed, KeyframeStore const & keyframes, OutputT & output)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    auto seedKeyframes = keyframes.Read<DIMENSION>(seed);
+    auto const & keyframe = KeyframeBefore(seedKeyframes.mKeyframes, *options.mFromEpoch);
+    std::cerr << "Replaying seed " << seed << " from the keyframe at epoch " << keyframe.mEpoch
+        << " on " << seedKeyframes.mSettings.mThreadsPerSeed << " threads, as it was run" << std::endl;
+
+    // Another thread count splits the configuration differently and replays another run
+    auto replayOptions = engineOptions;
+    replayOptions.mThreadsPerSeed = seedKeyframes.mSettings.mThreadsPerSeed;
+
+    auto state = keyframe.mState;
+    auto startScore = ScoreAtContact(state, replayOptions.mContact);
+    EngineResult result;
+    WithEngine(replayOptions, [&](auto const & engine) {
+        if constexpr (requires { engine.template Resume<DIMENSION>(state, output, size_t{}, size_t{}); })
+        {
+            result = engine.template Resume<DIMENSION>(state, output, options.mBudget, keyframe.mEpoch);
+        }
+        else
+        {
+            ASSERT_MSG(false, "only the gd engine can replay from a keyframe");
+        }
+    });
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    return WorkResult{seed, startScore, result.mScore, result.mEpochs, elapsed.count(), result.mTermination};
+}
 
 int main(int nargs, char** argv){
-    ASSERT_MSG(nargs >= 2, "Missing arg - choose one of batch or analyse");
-    std::string mode(argv[1]);
+    auto options = ParseOptions(nargs, argv);
+    auto const & mode = options.mMode;
      
     size_t STARTING_SEED = 0;
     size_t STOPPING_SEED = 0;
     size_t nThreads = 0;
 
-    FileOutput fileOutput{"viewer/frames.json"};
-    NoOutput noOutput;
+    EngineOptions engineOptions;
+    engineOptions.mKind = options.mEngine;
+    engineOptions.mLoss = options.mLoss;
+    engineOptions.mStagnation = options.mStagnation;
+    engineOptions.mPolish = options.mPolish;
+    engineOptions.mContinuation = options.mContinuation;
+    engineOptions.mRigidity = options.mRigidity;
+    engineOptions.mContact = options.mContact;
+    engineOptions.mPipeline = options.mPipeline;
+    if (!options.mDescentPath.empty())
+    {
+        engineOptions.mDescent = ReadDescentParams(options.mDescentPath, DIMENSION, targetBalls);
+    }
 
-    if (mode == "batch")
+    if (mode == "coordinate")
+    {
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} coordinate <ledger>", argv[0]);
+        ShardLedger ledger(options.mPositional[0]);
+        if (!std::filesystem::exists(options.mPositional[0]))
+        {
+            ledger.Create(options.mFirstSeed, options.mLastSeed, options.mShardSeeds, options.mLeaseSeconds);
+        }
+
+        auto status = ledger.Status();
+        std::cerr << "free=" << status.mFree << " leased=" << status.mLeased << " expired=" << status.mExpired << " done=" << status.mDone << std::endl;
+        return 0;
+    }
+    else if (mode == "merge")
     {
-        STARTING_SEED = 12345;
-        STOPPING_SEED = 1234567;
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} merge <results_dir>", argv[0]);
+        auto results = MergeShardResults(options.mPositional[0]);
+        for (auto const & result : results)
+        {
+            PrintResult(result, std::cout);
+        }
+        PrintSummary(results, std::cerr);
+        return 0;
+    }
+    else if (mode == "batch" || mode == "work")
+    {
+        STARTING_SEED = options.mFirstSeed;
+        STOPPING_SEED = options.mLastSeed;
         // I'm gunna assume everything is hyperthreaded these days and that we don't want hyperthreads
         nThreads = std::thread::hardware_concurrency() /2 -1;
         ASSERT_MSG(nThreads > 0, "Could not determine thread count - pls hardcode");
         std::cerr << "Running on " << nThreads << " threads" << std::endl;
         nThreads = 7;
     }
+    else if (mode == "ramp")
+    {
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} ramp <seed_number>", argv[0]);
+        // One configuration at a time, so it gets the machine
+        nThreads = 1;
+        engineOptions.mThreadsPerSeed = std::max(1u, std::thread::hardware_concurrency());
+    }
+    else if (mode == "maxmin")
+    {
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} maxmin <seed_number>", argv[0]);
+        ASSERT_MSG(options.mEngine == EngineKind::GradientDescent, "only the gd engine takes a contact angle");
+        nThreads = 1;
+        engineOptions.mThreadsPerSeed = std::max(1u, std::thread::hardware_concurrency());
+    }
+    else if (mode == "tune")
+    {
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} tune <config_out>", argv[0]);
+        ASSERT_MSG(options.mEngine == EngineKind::GradientDescent, "tune fits the gd engine's constants");
+        // A budget would override every candidate's outer_epochs
+        ASSERT_MSG(options.mBudget == 0, "tune fits outer_epochs itself - drop --budget");
+        nThreads = std::max(1u, std::thread::hardware_concurrency() / 2);
+    }
+    else if (mode == "rigidity")
+    {
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} rigidity <seed_number>", argv[0]);
+        nThreads = 1;
+        engineOptions.mThreadsPerSeed = std::max(1u, std::thread::hardware_concurrency());
+    }
     else if (mode == "analyse")
     {
-        ASSERT_MSG(nargs >= 3, "use {} analyse <seed_number>", argv[0]);
-        auto seed = std::stoll(argv[2]);
+        ASSERT_MSG(options.mPositional.size() >= 1, "use {} analyse <seed_number>", argv[0]);
+        auto seed = std::stoll(options.mPositional[0]);
         STARTING_SEED = seed;
         STOPPING_SEED = seed;
         nThreads = 1;
+        // One seed, so let engines that can parallelise within a configuration have the machine
+        engineOptions.mThreadsPerSeed = std::max(1u, std::thread::hardware_concurrency());
     }
     else
     {
         ASSERT_MSG(false, "unkown mode");
     }
 
-    std::atomic<size_t> nextSeed{STARTING_SEED};
-    ThreadSafeQueue<WorkResult> results{nThreads};
-    std::vector<std::thread> threads;
+    if (options.mThreads)
+    {
+        nThreads = options.mThreads;
+    }
+
+    std::cerr << "Engine " << EngineName(engineOptions.mKind) << " (" << LossName(engineOptions.mLoss) << " loss), " << DIMENSION << "D, " << targetBalls << " balls, "
+        << KernelIsaName() << " kernels" << std::endl;
 
-    for (size_t i = 0; i < nThreads; i++)
+    if (mode == "ramp")
     {
-        if (mode == "batch")
+        auto seed = std::stoull(options.mPositional[0]);
+        auto startBalls = options.mStartBalls ? options.mStartBalls : targetBalls * 3 / 4;
+        size_t reached = 0;
+        if (options.mRampOut.empty())
         {
-            threads.emplace_back([&nextSeed, &results, STOPPING_SEED, &noOutput]{ return workerThread(nextSeed, results, noOutput, STOPPING_SEED);});
+            NoOutput noOutput;
+            reached = RunRamp(engineOptions, options, seed, startBalls, noOutput);
         }
         else
         {
-            threads.emplace_back([&nextSeed, &results, STOPPING_SEED, &fileOutput]{ return workerThread(nextSeed, results, fileOutput, STOPPING_SEED);});
+            FileOutput fileOutput(options.mRampOut);
+            reached = RunRamp(engineOptions, options, seed, startBalls, fileOutput);
         }
+        std::cerr << "Largest valid configuration: " << reached << " balls" << std::endl;
+        return 0;
     }
 
-    while (true)
+    if (mode == "maxmin")
     {
-        auto entry = results.PopWait();
-        if (!entry.has_value())
+        auto best = RunMaxMin(engineOptions, options, std::stoull(options.mPositional[0]), targetBalls);
+        auto maxCos = MaxPairCos(best);
+        std::cerr << "Best minimum angle: " << std::acos(maxCos) * 180 / std::numbers::pi << " degrees (cos " << maxCos << ")" << std::endl;
+        if (!options.mMaxMinOut.empty())
         {
-            break;
+            FileOutput fileOutput(options.mMaxMinOut);
+            fileOutput.WriteRow(best);
         }
+        return 0;
+    }
+
+    if (mode == "tune")
+    {
+        RunTune(engineOptions, options, nThreads, options.mPositional[0]);
+        return 0;
+    }
+
+    if (mode == "rigidity")
+    {
+        PrintRigidity(engineOptions, options, std::stoull(options.mPositional[0]), targetBalls);
+        return 0;
+    }
 
-        std::cout << "(" << entry->mSeed  << "," << entry->mStartScore << "," << entry->mScore << ")," << std::endl;
+    std::optional<LiveStats> liveStats;
+    if (!options.mStatsPath.empty())
+    {
+        liveStats.emplace(LiveStats::Create(options.mStatsPath, nThreads, DIMENSION, targetBalls));
+    }
+
+    std::optional<TrajectoryExporter> exporter;
+    if (!options.mExportDir.empty())
+    {
+        exporter.emplace(options.mExportDir, DIMENSION, targetBalls, options.mExportStride, options.mExportShardSeeds);
+    }
+
+    std::optional<KeyframeStore> keyframes;
+    if (!options.mKeyframeDir.empty())
+    {
+        ASSERT_MSG(options.mEngine == EngineKind::GradientDescent, "keyframes replay gd runs only");
+        ASSERT_MSG(options.mContinuation.mStartViolation == 0, "keyframes hold positions only, not the continuation schedule");
+        ASSERT_MSG(options.mRigidity.mEveryEpochs == 0, "keyframes hold positions only, not the rigidity checks");
+        ASSERT_MSG(options.mKeyframeEvery % LocalityOrder<DIMENSION>::ReorderEpochs == 0,
+            "--keyframe-every must be a multiple of {} so replays restart on a reorder", LocalityOrder<DIMENSION>::ReorderEpochs);
+        KeyframeRunSettings settings{engineOptions.mThreadsPerSeed, engineOptions.mLoss, engineOptions.mContact, engineOptions.mDescent};
+        keyframes.emplace(options.mKeyframeDir, options.mKeyframeEvery, settings, options.mKeyframeBelow);
+    }
+
+    RunSinks sinks{liveStats ? &*liveStats : nullptr, exporter ? &*exporter : nullptr, keyframes ? &*keyframes : nullptr};
+
+    if (mode == "work")
+    {
+        ASSERT_MSG(options.mPositional.size() >= 2, "use {} work <ledger> <results_dir>", argv[0]);
+        RunShards(engineOptions, options, options.mPositional[0], options.mPositional[1], nThreads, sinks);
+        return 0;
     }
 
-    for (auto & thread : threads)
+    std::vector<WorkResult> allResults;
+    if (mode == "analyse" && options.mFromEpoch)
+    {
+        ASSERT_MSG(keyframes, "--from-epoch needs the --keyframes directory the batch wrote");
+        FileOutput fileOutput("viewer/frames.json");
+        allResults.push_back(ReplaySeed(engineOptions, options, STARTING_SEED, *keyframes, fileOutput));
+        PrintResult(allResults.back(), std::cout);
+    }
+    else if (mode == "analyse")
     {
-        thread.join();
+        // Only the analyse mode writes frames, and it runs a single worker
+        FileOutput fileOutput("viewer/frames.json");
+        allResults = RunSeeds(engineOptions, options, STARTING_SEED, STOPPING_SEED, nThreads, fileOutput, std::cout, sinks);
     }
+    else
+    {
+        NoOutput noOutput;
+        allResults = RunSeeds(engineOptions, options, STARTING_SEED, STOPPING_SEED, nThreads, noOutput, std::cout, sinks);
+    }
+
+    PrintSummary(allResults, std::cerr);
 
     return 0;
 }
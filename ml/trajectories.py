@@ -0,0 +1,53 @@
+"""Reader for the trajectory shards written by `kissing_searcher batch --export <dir>`.
+
+See trajectory_export.h for the layout.
+"""
+
+import json
+import struct
+import zlib
+from pathlib import Path
+
+import numpy as np
+
+_DTYPES = {0: np.uint64, 1: np.float64, 2: np.float32}
+
+
+def read_shard(path):
+    """Returns a dict of column name to numpy array."""
+    data = Path(path).read_bytes()
+    if data[:8] != b"KSTRAJ1\0":
+        raise ValueError(f"{path} is not a trajectory shard")
+
+    (n_columns,) = struct.unpack_from("<I", data, 8)
+    offset = 12
+    columns = {}
+    for _ in range(n_columns):
+        (name_length,) = struct.unpack_from("<H", data, offset)
+        offset += 2
+        name = data[offset:offset + name_length].decode()
+        offset += name_length
+        dtype, rank = struct.unpack_from("<BB", data, offset)
+        offset += 2
+        shape = struct.unpack_from(f"<{rank}Q", data, offset)
+        offset += 8 * rank
+        (compressed_bytes,) = struct.unpack_from("<Q", data, offset)
+        offset += 8
+        raw = zlib.decompress(data[offset:offset + compressed_bytes])
+        offset += compressed_bytes
+        columns[name] = np.frombuffer(raw, dtype=_DTYPES[dtype]).reshape(shape)
+    return columns
+
+
+def iter_trajectories(directory):
+    """Yields (seed, final_score, columns) per seed, with the per frame columns sliced to that seed."""
+    directory = Path(directory)
+    manifest = json.loads((directory / "manifest.json").read_text())
+    for shard in manifest["shards"]:
+        columns = read_shard(directory / shard["file"])
+        offsets = columns["frame_offset"]
+        for i, seed in enumerate(columns["seed"]):
+            rows = slice(int(offsets[i]), int(offsets[i + 1]))
+            yield int(seed), float(columns["final_score"][i]), {
+                name: columns[name][rows] for name in ("frame", "score", "points", "step_size")
+            }
@@ -4,6 +4,7 @@
 #include "debug_output.h"
 #include "file_output.h"
 #include "initial_states.h"
+#include "kernel_dispatch.h"
 #include "vectors.h"
 #include <stdint.h>
 #include <random>
@@ -16,27 +17,46 @@ bool CloserThanSafe(Vector<Dim> const & a, Vector<Dim> const & b, double bound)
 }
 
 
+static constexpr PointType NeighbourMargin = 1.2;
+
+// Squared distance margin keeping the same slack below a contact cos theta other than 0.5 as
+// margin keeps below 0.5
+inline double NeighbourMarginFor(double contact, double margin = NeighbourMargin)
+{
+    return margin + 2 * (0.5 - contact);
+}
+
+// Appends the neighbours of pointId with a higher id, so each pair is listed once
 template <size_t Dim>
-NeighboursLookup ConstructPointNeighbours(std::vector<Vector<Dim>> const & points)
+KISSING_KERNEL void FindHigherNeighbours(std::vector<Vector<Dim>> const & points, PointId pointId, double margin, std::vector<PointId> & neighbours)
 {
-    static constexpr PointType margin = 1.2;
+    auto const & point = points[pointId];
+    for (PointId maybeNeighbourId = pointId+1; maybeNeighbourId < points.size(); maybeNeighbourId++)
+    {
+        if (CloserThanSafe(point, points[maybeNeighbourId], margin)) {
+            neighbours.push_back(maybeNeighbourId);
+        }
+    }
+}
 
+template <size_t Dim>
+NeighboursLookup ConstructPointNeighbours(std::vector<Vector<Dim>> const & points, double margin)
+{
     std::vector<std::vector<PointId>> ret;
     for (PointId pointId = 0; pointId < points.size(); pointId++)
     {
-        auto const & point = points[pointId];
-        auto & neighbours = ret.emplace_back();
-        for (PointId maybeNeighbourId = pointId+1; maybeNeighbourId < points.size(); maybeNeighbourId++)
-        {
-            if (CloserThanSafe(point, points[maybeNeighbourId], margin)) {
-                neighbours.push_back(maybeNeighbourId);
-            }
-        }
+        FindHigherNeighbours(points, pointId, margin, ret.emplace_back());
     }
 
     return ret;
 }
 
+template <size_t Dim>
+NeighboursLookup ConstructPointNeighbours(std::vector<Vector<Dim>> const & points)
+{
+    return ConstructPointNeighbours(points, NeighbourMargin);
+}
+
 template <size_t Dim>
 NeighboursLookup ConstructPointNeighboursBidi(std::vector<Vector<Dim>> const & points, double margin)
 {
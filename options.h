@@ -0,0 +1,237 @@
+#pragma once
+
+#include "debug_output.h"
+#include "engines.h"
+#include "lattice_seeds.h"
+#include "tuner.h"
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+// kissing_searcher <mode> [positional...] [--flag value...]
+struct RunOptions
+{
+    std::string mMode;
+    std::vector<std::string> mPositional;
+    EngineKind mEngine = EngineKind::GradientDescent;
+    // Stages when mEngine is a pipeline
+    std::vector<PipelineStageSpec> mPipeline;
+    LossKind mLoss = LossKind::Reciprocal;
+    StagnationParams mStagnation;
+    PolishParams mPolish;
+    ContinuationParams mContinuation;
+    RigidityParams mRigidity;
+    // 0 means the engine's default budget
+    size_t mBudget = 0;
+    // 0 means the mode's default thread count
+    size_t mThreads = 0;
+    SeedOptions mSeed;
+    // Riesz repulsion steps run on each seed before the engine
+    size_t mWarmStartSteps = 0;
+    // Batch seed range, inclusive
+    size_t mFirstSeed = 12345;
+    size_t mLastSeed = 1234567;
+    // Sharded batches: seeds per shard when the coordinator writes the ledger, and how long a
+    // worker's claim on a shard lasts without renewal
+    size_t mShardSeeds = 256;
+    int64_t mLeaseSeconds = 900;
+    // Memory mapped file to publish live progress to for kissing_top, none if empty
+    std::string mStatsPath;
+    // Trajectory dataset export: directory (none if empty), frames between samples, seeds per shard
+    std::string mExportDir;
+    size_t mExportStride = 10;
+    size_t mExportShardSeeds = 64;
+    // Ramp mode: balls in the cold start (0 for three quarters of the target), stop after this
+    // many (0 for no limit), deep holes tried per rung, file for each valid configuration
+    size_t mStartBalls = 0;
+    size_t mMaxBalls = 0;
+    size_t mHoleAttempts = 4;
+    std::string mRampOut;
+    // Keyframes: directory batch writes them to and analyse reads them from (none if empty),
+    // epochs between them (a multiple of LocalityOrder::ReorderEpochs), and only seeds finishing
+    // at or below this score are kept
+    std::string mKeyframeDir;
+    size_t mKeyframeEvery = 1024;
+    double mKeyframeBelow = std::numeric_limits<double>::infinity();
+    // Analyse mode: replay from the last keyframe at or before this epoch
+    std::optional<size_t> mFromEpoch;
+    // Cos theta of contact for the gd engine - 0.5 is kissing. In maxmin mode the first probe's.
+    double mContact = 0.5;
+    // Maxmin mode: bisection probes after the cold run, file for the best configuration
+    size_t mBisectSteps = 16;
+    std::string mMaxMinOut;
+    // Descent constants file tune wrote, none (the built in defaults) if empty
+    std::string mDescentPath;
+    // Tune mode: candidates and first round seeds of the successive halving
+    TuneParams mTune;
+};
+
+inline RunOptions ParseOptions(int nargs, char ** argv)
+{
+    ASSERT_MSG(nargs >= 2, "Missing arg - choose one of batch, analyse, ramp, maxmin, rigidity, tune, coordinate, work or merge");
+
+    RunOptions ret;
+    ret.mMode = argv[1];
+
+    for (int i = 2; i < nargs; i++)
+    {
+        std::string arg(argv[i]);
+        if (!arg.starts_with("--"))
+        {
+            ret.mPositional.push_back(arg);
+            continue;
+        }
+
+        ASSERT_MSG(i + 1 < nargs, "Missing value for {}", arg);
+        std::string value(argv[++i]);
+
+        if (arg == "--engine")
+        {
+            ret.mEngine = ParseEngineKind(value);
+        }
+        else if (arg == "--pipeline")
+        {
+            ret.mEngine = EngineKind::Pipeline;
+            ret.mPipeline = ParsePipeline(value);
+        }
+        else if (arg == "--loss")
+        {
+            ret.mLoss = ParseLossKind(value);
+        }
+        else if (arg == "--patience")
+        {
+            ret.mStagnation.mPatience = std::stoull(value);
+        }
+        else if (arg == "--max-seconds")
+        {
+            ret.mStagnation.mMaxSeconds = std::stod(value);
+        }
+        else if (arg == "--polish-below")
+        {
+            ret.mPolish.mStartViolation = std::stod(value);
+        }
+        else if (arg == "--continuation")
+        {
+            ret.mContinuation.mStartViolation = std::stod(value);
+        }
+        else if (arg == "--rigidity-every")
+        {
+            ret.mRigidity.mEveryEpochs = std::stoull(value);
+        }
+        else if (arg == "--budget")
+        {
+            ret.mBudget = std::stoull(value);
+        }
+        else if (arg == "--threads")
+        {
+            ret.mThreads = std::stoull(value);
+        }
+        else if (arg == "--init")
+        {
+            ret.mSeed.mShell = ParseSeedShell(value);
+        }
+        else if (arg == "--perturb")
+        {
+            ret.mSeed.mPerturbation = std::stod(value);
+        }
+        else if (arg == "--warm-start")
+        {
+            ret.mWarmStartSteps = std::stoull(value);
+        }
+        else if (arg == "--first-seed")
+        {
+            ret.mFirstSeed = std::stoull(value);
+        }
+        else if (arg == "--last-seed")
+        {
+            ret.mLastSeed = std::stoull(value);
+        }
+        else if (arg == "--shard-seeds")
+        {
+            ret.mShardSeeds = std::stoull(value);
+        }
+        else if (arg == "--lease")
+        {
+            ret.mLeaseSeconds = std::stoll(value);
+        }
+        else if (arg == "--stats")
+        {
+            ret.mStatsPath = value;
+        }
+        else if (arg == "--export")
+        {
+            ret.mExportDir = value;
+        }
+        else if (arg == "--export-stride")
+        {
+            ret.mExportStride = std::stoull(value);
+        }
+        else if (arg == "--export-shard-seeds")
+        {
+            ret.mExportShardSeeds = std::stoull(value);
+        }
+        else if (arg == "--start-balls")
+        {
+            ret.mStartBalls = std::stoull(value);
+        }
+        else if (arg == "--max-balls")
+        {
+            ret.mMaxBalls = std::stoull(value);
+        }
+        else if (arg == "--hole-attempts")
+        {
+            ret.mHoleAttempts = std::stoull(value);
+        }
+        else if (arg == "--ramp-out")
+        {
+            ret.mRampOut = value;
+        }
+        else if (arg == "--keyframes")
+        {
+            ret.mKeyframeDir = value;
+        }
+        else if (arg == "--keyframe-every")
+        {
+            ret.mKeyframeEvery = std::stoull(value);
+        }
+        else if (arg == "--keyframe-below")
+        {
+            ret.mKeyframeBelow = std::stod(value);
+        }
+        else if (arg == "--from-epoch")
+        {
+            ret.mFromEpoch = std::stoull(value);
+        }
+        else if (arg == "--contact")
+        {
+            ret.mContact = std::stod(value);
+        }
+        else if (arg == "--bisect-steps")
+        {
+            ret.mBisectSteps = std::stoull(value);
+        }
+        else if (arg == "--descent")
+        {
+            ret.mDescentPath = value;
+        }
+        else if (arg == "--tune-candidates")
+        {
+            ret.mTune.mCandidates = std::stoull(value);
+        }
+        else if (arg == "--tune-seeds")
+        {
+            ret.mTune.mSeeds = std::stoull(value);
+        }
+        else if (arg == "--maxmin-out")
+        {
+            ret.mMaxMinOut = value;
+        }
+        else
+        {
+            ASSERT_MSG(false, "unknown option {}", arg);
+        }
+    }
+
+    return ret;
+}
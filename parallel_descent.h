@@ -0,0 +1,162 @@
+#pragma once
+
+#include "dot_diffs.h"
+#include "thread_pool.h"
+#include <algorithm>
+
+// Splits one configuration's descent across a thread pool. Points are cut into blocks that fit
+// comfortably in L1 and dealt round-robin to threads. Each thread pushes its blocks' pairs into
+// its own accumulator, then owns the same blocks for the reduction and the position update, so
+// there are no atomics and two barriers per inner iteration.
+// Results differ from the serial path only in the order forces are summed.
+template <size_t Dim>
+class ParallelDescent
+{
+    public:
+    static constexpr size_t BlockBytes = 16 * 1024;
+    static constexpr size_t CacheBlockPoints = std::max<size_t>(16, BlockBytes / sizeof(Vector<Dim>));
+    // Enough blocks per thread that the round robin evens out the triangular neighbour lists
+    static constexpr size_t BlocksPerThread = 4;
+
+    // Below this the barriers cost more than the pair loop they split
+    static constexpr size_t MinPoints = 256;
+
+    ParallelDescent(ThreadPool & pool, size_t nPoints)
+        : mPool(pool)
+        , mNPoints(nPoints)
+        , mBlockPoints(std::clamp<size_t>(nPoints / (pool.Size() * BlocksPerThread), 1, CacheBlockPoints))
+        , mNBlocks((nPoints + mBlockPoints - 1) / mBlockPoints)
+        , mMags(nPoints)
+        , mInvMags(nPoints)
+        , mAccumulators(pool.Size(), std::vector<Vector<Dim>>(nPoints))
+        , mMaxForces(pool.Size())
+        , mMaxSteps(pool.Size())
+    {
+    }
+
+    static bool Worthwhile(ThreadPool const * pool, size_t nPoints)
+    {
+        return pool && pool->Size() > 1 && nPoints >= MinPoints;
+    }
+
+    // Same lookup as ConstructPointNeighbours
+    void ConstructNeighbours(std::vector<Vector<Dim>> const & points, NeighboursLookup & lookup, double margin)
+    {
+        lookup.resize(points.size());
+        auto task = [&](size_t threadIdx) {
+            ForOwnPoints(threadIdx, [&](PointId pointId) {
+                lookup[pointId].clear();
+                FindHigherNeighbours(points, pointId, margin, lookup[pointId]);
+            });
+        };
+
+        mPool.RunOnAll(task);
+    }
+
+    // Equivalent to InnerIterationLoops rounds of CalcDotDiffs followed by Acc into the state.
+    // Returns the largest squared step of the last round.
+    template <typename LossFunc>
+    double RunInnerLoops(std::vector<Vector<Dim>> & points, NeighboursLookup const & neighbours, std::vector<Vector<Dim>> & rets, size_t InnerIterationLoops, LossFunc lossFunc)
+    {
+        auto task = [&](size_t threadIdx) {
+            RunThreadInnerLoops(threadIdx, points, neighbours, rets, InnerIterationLoops, lossFunc);
+        };
+
+        mPool.RunOnAll(task);
+
+        double maxStepSq = 0;
+        for (auto const & threadMax : mMaxSteps)
+        {
+            maxStepSq = std::max(maxStepSq, threadMax.mValue);
+        }
+        return maxStepSq;
+    }
+
+    private:
+    // One thread's share of RunInnerLoops
+    template <typename LossFunc>
+    void RunThreadInnerLoops(size_t threadIdx, std::vector<Vector<Dim>> & points, NeighboursLookup const & neighbours, std::vector<Vector<Dim>> & rets, size_t InnerIterationLoops, LossFunc lossFunc)
+    {
+        auto & barrier = mPool.Barrier();
+        auto & accumulator = mAccumulators[threadIdx];
+        auto const quadDelta = StepOf(lossFunc).mQuadDelta;
+
+        ForOwnPoints(threadIdx, [&](PointId pointId) {
+            UpdateMag(points, pointId);
+        });
+        barrier.ArriveAndWait();
+
+        for (size_t innerEpoch = 0; innerEpoch < InnerIterationLoops; innerEpoch++)
+        {
+            for (auto & vec : accumulator)
+            {
+                vec.Zero();
+            }
+
+            double maxForce = 0.1;
+            ForOwnPoints(threadIdx, [&](PointId pointId) {
+                maxForce = AccumulatePairDiffs<Dim>(points, mMags, mInvMags, neighbours[pointId], pointId, accumulator, lossFunc, maxForce);
+            });
+            mMaxForces[threadIdx].mValue = maxForce;
+
+            barrier.ArriveAndWait();
+
+            for (auto const & threadMax : mMaxForces)
+            {
+                maxForce = std::max(maxForce, threadMax.mValue);
+            }
+
+            double maxStepSq = 0;
+            ForOwnPoints(threadIdx, [&](PointId pointId) {
+                auto & ret = rets[pointId];
+                ret.Zero();
+                for (auto const & threadAccumulator : mAccumulators)
+                {
+                    Acc(ret, threadAccumulator[pointId]);
+                }
+
+                FinishDiff(points[pointId], mMags[pointId], maxForce, ret, quadDelta);
+                maxStepSq = std::max(maxStepSq, Dot(ret, ret));
+                Acc(points[pointId], ret);
+                UpdateMag(points, pointId);
+            });
+            mMaxSteps[threadIdx].mValue = maxStepSq;
+
+            barrier.ArriveAndWait();
+        }
+    }
+
+    void UpdateMag(std::vector<Vector<Dim>> const & points, PointId pointId)
+    {
+        mMags[pointId] = std::sqrt(Dot(points[pointId], points[pointId]));
+        mInvMags[pointId] = 1 / mMags[pointId];
+    }
+
+    template <typename Func>
+    void ForOwnPoints(size_t threadIdx, Func && func)
+    {
+        for (size_t block = threadIdx; block < mNBlocks; block += mPool.Size())
+        {
+            auto end = std::min(mNPoints, (block + 1) * mBlockPoints);
+            for (PointId pointId = block * mBlockPoints; pointId < end; pointId++)
+            {
+                func(pointId);
+            }
+        }
+    }
+
+    struct alignas(64) PaddedValue
+    {
+        double mValue;
+    };
+
+    ThreadPool & mPool;
+    size_t mNPoints;
+    size_t mBlockPoints;
+    size_t mNBlocks;
+    std::vector<PointType> mMags;
+    std::vector<PointType> mInvMags;
+    std::vector<std::vector<Vector<Dim>>> mAccumulators;
+    std::vector<PaddedValue> mMaxForces;
+    std::vector<PaddedValue> mMaxSteps;
+};
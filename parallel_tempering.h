@@ -0,0 +1,183 @@
+#pragma once
+
+#include "simulated_annealing.h"
+#include "neighbours.h"
+#include <barrier>
+#include <thread>
+
+// Replica exchange: the same configuration is annealed at a ladder of fixed temperatures, and
+// neighbouring rungs periodically offer to swap configurations. Cold rungs refine, hot rungs
+// escape the traps a single cooling chain (RunAnnealing) gets stuck in.
+struct TemperingParams
+{
+    size_t mReplicas = 16;
+    size_t mThreads = 1;
+    size_t mSwapRounds = 1000;
+    // Moves made by every replica between two swap barriers
+    size_t mMovesPerRound = 10000;
+    // Moves between neighbour lookup rebuilds - 0 means once per ball
+    size_t mNeighbourRebuildMoves = 0;
+    // Same starting temperature as RunAnnealing - it is the hottest rung
+    double mHottestFraction = 1.0 / 16;
+    // Coldest rung relative to the hottest - RunAnnealing ends around (7/8)^100 ~ 1.6e-6
+    double mColdestRatio = 1e-5;
+};
+
+struct LadderStats
+{
+    double mTemperature;
+    size_t mProposals;
+    size_t mAccepted;
+    // Swaps offered to the next hotter rung
+    size_t mSwapAttempts;
+    size_t mSwapsAccepted;
+
+    double AcceptanceRate() const
+    {
+        return mProposals ? static_cast<double>(mAccepted) / mProposals : 0;
+    }
+
+    double SwapRate() const
+    {
+        return mSwapAttempts ? static_cast<double>(mSwapsAccepted) / mSwapAttempts : 0;
+    }
+};
+
+struct TemperingResult
+{
+    std::vector<LadderStats> mLadder;
+    double mFinalEnergy;
+};
+
+template <size_t Dim>
+struct Replica
+{
+    std::vector<Vector<Dim>> mState;
+    NeighboursLookup mLookup;
+    double mEnergy;
+};
+
+// Per-rung mutable state, padded so threads working on neighbouring rungs don't share cache lines
+template <typename Rand>
+struct alignas(64) Rung
+{
+    Rand mRand;
+    LadderStats mStats;
+};
+
+inline std::vector<double> TemperatureLadder(double hottest, double coldest, size_t nRungs)
+{
+    // Geometric spacing keeps swap acceptance roughly even along the ladder
+    std::vector<double> ret;
+    for (size_t rung = 0; rung < nRungs; rung++)
+    {
+        auto frac = nRungs > 1 ? static_cast<double>(rung) / (nRungs - 1) : 0;
+        ret.push_back(coldest * std::pow(hottest / coldest, frac));
+    }
+
+    return ret;
+}
+
+// Rung 0 is the coldest. Each rung keeps its own rng and stats, configurations move between rungs.
+// Replicas are only touched by their owning thread, except inside the barrier completion where all
+// other threads are parked.
+template <size_t Dim, typename Rand, typename OutputT>
+TemperingResult RunParallelTempering(std::vector<Vector<Dim>> & initialState, Rand & rand, OutputT & frameOutput, TemperingParams const & params)
+{
+    ASSERT(params.mReplicas > 0);
+    ASSERT(params.mThreads > 0);
+
+    auto const nRungs = params.mReplicas;
+    auto const nThreads = std::min(params.mThreads, nRungs);
+    auto const rebuildMoves = params.mNeighbourRebuildMoves ? params.mNeighbourRebuildMoves : initialState.size();
+
+    auto startLookup = ConstructPointNeighboursBidi(initialState, ScaledBound(1.2));
+    auto startEnergy = Energy(initialState, startLookup);
+    auto hottest = startEnergy * params.mHottestFraction;
+    auto temperatures = TemperatureLadder(hottest, hottest * params.mColdestRatio, nRungs);
+
+    std::vector<Replica<Dim>> replicas;
+    std::vector<Rung<Rand>> rungs;
+    for (size_t rung = 0; rung < nRungs; rung++)
+    {
+        replicas.push_back(Replica<Dim>{initialState, startLookup, startEnergy});
+        rungs.push_back(Rung<Rand>{SplitStream(rand, rung), LadderStats{temperatures[rung], 0, 0, 0, 0}});
+    }
+
+    std::uniform_real_distribution<double> realDistn(0, 1);
+    size_t round = 0;
+
+    auto attemptSwaps = [&]() noexcept {
+        // Alternate even and odd pairs so every rung gets a chance each two rounds
+        for (size_t rung = round % 2; rung + 1 < nRungs; rung += 2)
+        {
+            auto & cold = replicas[rung];
+            auto & hot = replicas[rung + 1];
+            auto exponent = (1 / temperatures[rung] - 1 / temperatures[rung + 1]) * (cold.mEnergy - hot.mEnergy);
+
+            rungs[rung].mStats.mSwapAttempts++;
+            if (exponent >= 0 || DrawUniform(rand, realDistn) < std::exp(exponent))
+            {
+                std::swap(cold, hot);
+                rungs[rung].mStats.mSwapsAccepted++;
+            }
+        }
+
+        frameOutput.WriteRow(replicas[0].mState);
+        round++;
+    };
+
+    std::barrier swapBarrier(nThreads, attemptSwaps);
+
+    auto runThread = [&](size_t threadIdx) {
+        for (size_t swapRound = 0; swapRound < params.mSwapRounds; swapRound++)
+        {
+            for (size_t rung = threadIdx; rung < nRungs; rung += nThreads)
+            {
+                auto & replica = replicas[rung];
+                auto & rungState = rungs[rung];
+                std::uniform_int_distribution<size_t> intDistn(0, replica.mState.size() - 1);
+
+                size_t accepted = 0;
+                for (size_t move = 0; move < params.mMovesPerRound; move++)
+                {
+                    if (move % rebuildMoves == 0)
+                    {
+                        replica.mLookup = ConstructPointNeighboursBidi(replica.mState, ScaledBound(1.2));
+                    }
+
+                    accepted += TryMove(replica.mState, replica.mLookup, temperatures[rung], intDistn, rungState.mRand);
+                }
+
+                rungState.mStats.mProposals += params.mMovesPerRound;
+                rungState.mStats.mAccepted += accepted;
+
+                replica.mLookup = ConstructPointNeighboursBidi(replica.mState, ScaledBound(1.2));
+                replica.mEnergy = Energy(replica.mState, replica.mLookup);
+            }
+
+            swapBarrier.arrive_and_wait();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t threadIdx = 1; threadIdx < nThreads; threadIdx++)
+    {
+        threads.emplace_back(runThread, threadIdx);
+    }
+    runThread(0);
+
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+
+    TemperingResult result{{}, replicas[0].mEnergy};
+    for (auto const & rungState : rungs)
+    {
+        result.mLadder.push_back(rungState.mStats);
+    }
+
+    initialState = std::move(replicas[0].mState);
+    return result;
+}
@@ -0,0 +1,302 @@
+#pragma once
+
+#include "fast_math.h"
+#include "kernel_dispatch.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstring>
+#include <numbers>
+#include <random>
+#include <stdint.h>
+#include <stddef.h>
+
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3"). Output block n of stream s under key k is a pure function of (k, n, s), so a seed's
+// results don't depend on which thread runs it, and streams split off for replicas or worker
+// shards never overlap.
+//
+// Satisfies UniformRandomBitGenerator so it drops into every Rand & parameter. It also hands out
+// Gaussians and uniforms from a buffer refilled in batches, which RandPoint and AcceptTransition
+// pick up through BatchGaussianRand.
+class Philox4x32
+{
+    public:
+    using result_type = uint32_t;
+
+    static constexpr size_t BatchBlocks = 16;
+    static constexpr size_t BatchSize = BatchBlocks * 4;
+
+    explicit Philox4x32(uint64_t seed, uint64_t stream = 0) : mSeed(seed), mStream(stream)
+    {
+    }
+
+    static constexpr result_type min()
+    {
+        return 0;
+    }
+
+    static constexpr result_type max()
+    {
+        return UINT32_MAX;
+    }
+
+    result_type operator()()
+    {
+        if (mBitsIdx == 4)
+        {
+            GenerateBlocks(mNextBlock++, 1, mBits.data());
+            mBitsIdx = 0;
+        }
+
+        return mBits[mBitsIdx++];
+    }
+
+    // An independent generator for sub-stream id, e.g. one per replica
+    Philox4x32 Stream(uint64_t id) const
+    {
+        // Any fixed bijective mix works - streams only need to be distinct
+        return Philox4x32(mSeed, (mStream + 1) * 0x9E3779B97F4A7C15ull + id);
+    }
+
+    double NextGaussian()
+    {
+        if (mGaussianIdx == BatchSize)
+        {
+            FillGaussian(mGaussians.data());
+            mGaussianIdx = 0;
+        }
+
+        return mGaussians[mGaussianIdx++];
+    }
+
+    // Uniform on (0, 1)
+    double NextUniform()
+    {
+        if (mUniformIdx == BatchSize)
+        {
+            std::array<uint32_t, BatchSize> bits;
+            GenerateBlocks(mNextBlock, BatchBlocks, bits.data());
+            mNextBlock += BatchBlocks;
+            for (size_t i = 0; i < BatchSize; i++)
+            {
+                mUniforms[i] = ToUnitInterval(bits[i]);
+            }
+            mUniformIdx = 0;
+        }
+
+        return mUniforms[mUniformIdx++];
+    }
+
+    // BatchSize standard normals by Box-Muller. The log and sincos are branch free polynomial
+    // approximations (log within about 1e-15 relative, sincos 6e-12 absolute) so the whole batch
+    // vectorises.
+    KISSING_KERNEL void FillGaussian(double * out)
+    {
+        std::array<uint32_t, BatchSize> bits;
+        GenerateBlocks(mNextBlock, BatchBlocks, bits.data());
+        mNextBlock += BatchBlocks;
+
+        // Separate passes over plain arrays so each loop vectorises on its own
+        static constexpr size_t Pairs = BatchSize / 2;
+        std::array<double, Pairs> radius, sinVal, cosVal;
+        for (size_t i = 0; i < Pairs; i++)
+        {
+            radius[i] = std::sqrt(-2 * FastLog(ToUnitInterval(bits[i])));
+        }
+        for (size_t i = 0; i < Pairs; i++)
+        {
+            sinVal[i] = ToUnitInterval(bits[i + Pairs]);
+        }
+        SinCosTurns(sinVal.data(), cosVal.data(), Pairs);
+        for (size_t i = 0; i < Pairs; i++)
+        {
+            out[i] = radius[i] * cosVal[i];
+            out[i + Pairs] = radius[i] * sinVal[i];
+        }
+    }
+
+    // Blocks first..first+n of this stream, 4 words each. Rounds run across blocks in the inner
+    // loop so independent blocks fill the vector lanes.
+    KISSING_KERNEL void GenerateBlocks(uint64_t first, size_t n, uint32_t * out) const
+    {
+        static constexpr uint32_t M0 = 0xD2511F53;
+        static constexpr uint32_t M1 = 0xCD9E8D57;
+        static constexpr uint32_t W0 = 0x9E3779B9;
+        static constexpr uint32_t W1 = 0xBB67AE85;
+
+        std::array<uint32_t, BatchBlocks> c0, c1, c2, c3;
+        for (size_t start = 0; start < n; start += BatchBlocks)
+        {
+            auto count = std::min(BatchBlocks, n - start);
+            for (size_t b = 0; b < BatchBlocks; b++)
+            {
+                uint64_t block = first + start + b;
+                c0[b] = static_cast<uint32_t>(block);
+                c1[b] = static_cast<uint32_t>(block >> 32);
+                c2[b] = static_cast<uint32_t>(mStream);
+                c3[b] = static_cast<uint32_t>(mStream >> 32);
+            }
+
+            uint32_t k0 = static_cast<uint32_t>(mSeed);
+            uint32_t k1 = static_cast<uint32_t>(mSeed >> 32);
+            for (size_t round = 0; round < 10; round++)
+            {
+                for (size_t b = 0; b < BatchBlocks; b++)
+                {
+                    uint64_t p0 = static_cast<uint64_t>(M0) * c0[b];
+                    uint64_t p1 = static_cast<uint64_t>(M1) * c2[b];
+                    auto n0 = static_cast<uint32_t>(p1 >> 32) ^ c1[b] ^ k0;
+                    auto n1 = static_cast<uint32_t>(p1);
+                    auto n2 = static_cast<uint32_t>(p0 >> 32) ^ c3[b] ^ k1;
+                    auto n3 = static_cast<uint32_t>(p0);
+                    c0[b] = n0;
+                    c1[b] = n1;
+                    c2[b] = n2;
+                    c3[b] = n3;
+                }
+                k0 += W0;
+                k1 += W1;
+            }
+
+            for (size_t b = 0; b < count; b++)
+            {
+                auto * blockOut = out + (start + b) * 4;
+                blockOut[0] = c0[b];
+                blockOut[1] = c1[b];
+                blockOut[2] = c2[b];
+                blockOut[3] = c3[b];
+            }
+        }
+    }
+
+    private:
+    static double ToUnitInterval(uint32_t bits)
+    {
+        return (bits + 0.5) * (1.0 / 4294967296.0);
+    }
+
+    // 1 / ((first + 2k)(first + 2k + 1)) - the ratios between consecutive sin (first = 2) or
+    // cos (first = 1) Taylor terms
+    template <size_t NTerms>
+    static consteval std::array<double, NTerms> TaylorReciprocals(size_t first)
+    {
+        std::array<double, NTerms> ret{};
+        for (size_t k = 0; k < NTerms; k++)
+        {
+            auto n = static_cast<double>(first + 2 * k);
+            ret[k] = 1 / (n * (n + 1));
+        }
+        return ret;
+    }
+
+    // Floor of a small non-negative value. std::floor only vectorises under -fno-trapping-math,
+    // the int conversion always does.
+    static double Truncate(double x)
+    {
+        return static_cast<double>(static_cast<int32_t>(x));
+    }
+
+    // In place sin and cos of 2 pi turns for turns in [0, 1): reduce to a quadrant, Taylor on
+    // [0, pi/2). On entry values holds the turns, on exit the sines.
+    static void SinCosTurns(double * values, double * cosOut, size_t n)
+    {
+        // Taylor coefficients as products of reciprocals - divisions here would serialise the batch
+        static constexpr auto SinTerms = TaylorReciprocals<7>(2);
+        static constexpr auto CosTerms = TaylorReciprocals<8>(1);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            auto quarters = values[i] * 4;
+            auto quadrant = Truncate(quarters);
+            auto angle = (quarters - quadrant) * (std::numbers::pi / 2);
+            auto a2 = angle * angle;
+
+            double s = 1;
+            for (size_t k = SinTerms.size(); k-- > 0;)
+            {
+                s = 1 - a2 * SinTerms[k] * s;
+            }
+            s *= angle;
+
+            double c = 1;
+            for (size_t k = CosTerms.size(); k-- > 0;)
+            {
+                c = 1 - a2 * CosTerms[k] * c;
+            }
+
+            // Rotate by the quadrant with arithmetic rather than branches: odd quadrants swap sin
+            // and cos, sin is negative in quadrants 2 and 3, cos in quadrants 1 and 2
+            auto half = Truncate(quadrant * 0.5);
+            auto swap = quadrant - 2 * half;
+            auto cosHalf = Truncate((quadrant + 1) * 0.5);
+            auto cosNegative = cosHalf - 2 * Truncate(cosHalf * 0.5);
+
+            values[i] = (1 - 2 * half) * (s + swap * (c - s));
+            cosOut[i] = (1 - 2 * cosNegative) * (c + swap * (s - c));
+        }
+    }
+
+    uint64_t mSeed;
+    uint64_t mStream;
+    uint64_t mNextBlock = 0;
+
+    std::array<uint32_t, 4> mBits{};
+    size_t mBitsIdx = 4;
+
+    std::array<double, BatchSize> mGaussians{};
+    size_t mGaussianIdx = BatchSize;
+
+    std::array<double, BatchSize> mUniforms{};
+    size_t mUniformIdx = BatchSize;
+};
+
+// Generators that batch their own Gaussians and uniforms
+template <typename Rand>
+concept BatchGaussianRand = requires(Rand & rand) {
+    { rand.NextGaussian() } -> std::convertible_to<double>;
+    { rand.NextUniform() } -> std::convertible_to<double>;
+};
+
+// An independent generator derived from parent for sub-stream id
+template <typename Rand>
+Rand SplitStream(Rand & parent, uint64_t id)
+{
+    if constexpr (requires { parent.Stream(id); })
+    {
+        return parent.Stream(id);
+    }
+    else
+    {
+        return Rand(parent());
+    }
+}
+
+// Draws that use the generator's own batches when it has them, else the standard distribution
+template <typename Rand>
+double DrawGaussian(Rand & rand, std::normal_distribution<double> & fallback)
+{
+    if constexpr (BatchGaussianRand<Rand>)
+    {
+        return rand.NextGaussian();
+    }
+    else
+    {
+        return fallback(rand);
+    }
+}
+
+template <typename Rand>
+double DrawUniform(Rand & rand, std::uniform_real_distribution<double> & fallback)
+{
+    if constexpr (BatchGaussianRand<Rand>)
+    {
+        return rand.NextUniform();
+    }
+    else
+    {
+        return fallback(rand);
+    }
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "debug_output.h"
+#include "engine_result.h"
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Engines chained on one configuration, e.g. "anneal:50k -> gd:2000@2 -> polish". Each stage is
+//   engine[:budget][@max score]   (the suffixes in either order)
+// budget in the engine's own epochs (k and m suffixes, omitted for its default), and a seed only
+// enters the stage if its score on arrival is at most max score. A seed stops at the first
+// stage it solves or is gated out of. Cheap global stages go first, so the expensive local ones
+// only run on seeds that earn them.
+struct PipelineStageSpec
+{
+    std::string mEngine;
+    size_t mBudget = 0;
+    double mMaxScore = std::numeric_limits<double>::infinity();
+};
+
+inline std::string TrimSpaces(std::string const & text)
+{
+    auto first = text.find_first_not_of(" \t");
+    auto last = text.find_last_not_of(" \t");
+    return first == std::string::npos ? std::string() : text.substr(first, last - first + 1);
+}
+
+inline size_t ParseBudget(std::string const & text)
+{
+    size_t consumed = 0;
+    auto value = std::stod(text, &consumed);
+    auto suffix = text.substr(consumed);
+    ASSERT_MSG(suffix.empty() || suffix == "k" || suffix == "m", "bad stage budget {}", text);
+    return static_cast<size_t>(value * (suffix == "k" ? 1e3 : suffix == "m" ? 1e6 : 1));
+}
+
+inline double ParseMaxScore(std::string const & text)
+{
+    size_t consumed = 0;
+    auto value = std::stod(text, &consumed);
+    ASSERT_MSG(consumed == text.size(), "bad stage max score {}", text);
+    return value;
+}
+
+inline std::vector<PipelineStageSpec> ParsePipeline(std::string const & spec)
+{
+    std::vector<PipelineStageSpec> ret;
+    size_t start = 0;
+    while (start <= spec.size())
+    {
+        auto end = spec.find("->", start);
+        auto text = TrimSpaces(spec.substr(start, end == std::string::npos ? std::string::npos : end - start));
+        ASSERT_MSG(!text.empty(), "empty stage in pipeline {}", spec);
+
+        // The engine name runs to the first suffix, and the suffixes may come in either order
+        PipelineStageSpec stage;
+        auto suffix = text.find_first_of(":@");
+        stage.mEngine = TrimSpaces(text.substr(0, suffix));
+        bool budgetSet = false;
+        bool gateSet = false;
+        while (suffix != std::string::npos)
+        {
+            auto next = text.find_first_of(":@", suffix + 1);
+            auto value = TrimSpaces(text.substr(suffix + 1, next == std::string::npos ? std::string::npos : next - suffix - 1));
+            if (text[suffix] == ':')
+            {
+                ASSERT_MSG(!budgetSet, "two budgets in pipeline stage {}", text);
+                stage.mBudget = ParseBudget(value);
+                budgetSet = true;
+            }
+            else
+            {
+                ASSERT_MSG(!gateSet, "two max scores in pipeline stage {}", text);
+                stage.mMaxScore = ParseMaxScore(value);
+                gateSet = true;
+            }
+            suffix = next;
+        }
+        ASSERT_MSG(!stage.mEngine.empty(), "no engine in pipeline stage {}", text);
+        ret.push_back(stage);
+
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        start = end + 2;
+    }
+
+    return ret;
+}
+
+inline std::string StageName(PipelineStageSpec const & stage)
+{
+    auto ret = stage.mEngine + ":" + (stage.mBudget ? std::to_string(stage.mBudget) : std::string("default"));
+    if (stage.mMaxScore != std::numeric_limits<double>::infinity())
+    {
+        std::ostringstream gate;
+        gate << "@" << stage.mMaxScore;
+        ret += gate.str();
+    }
+    return ret;
+}
+
+// Per stage outcomes across every seed of a run. Workers share one, so the counters are atomic.
+class PipelineStats
+{
+    public:
+    explicit PipelineStats(std::vector<PipelineStageSpec> const & stages) : mStages(stages), mCounters(stages.size())
+    {
+    }
+
+    void RecordGated(size_t stage)
+    {
+        mCounters[stage].mGated++;
+    }
+
+    void RecordRun(size_t stage, EngineResult const & result, double seconds)
+    {
+        auto & counters = mCounters[stage];
+        counters.mRan++;
+        counters.mSolved += result.mScore == 0;
+        counters.mScore += result.mScore;
+        counters.mSeconds += seconds;
+    }
+
+    // One line per stage: seeds that ran it, were gated out before it and finished in it, and
+    // the CPU time and mean score out of it
+    void Print(std::ostream & out) const
+    {
+        for (size_t i = 0; i < mStages.size(); i++)
+        {
+            auto const & counters = mCounters[i];
+            auto ran = counters.mRan.load();
+            out << "stage " << i + 1 << " " << StageName(mStages[i])
+                << " ran=" << ran
+                << " gated=" << counters.mGated
+                << " solved=" << counters.mSolved
+                << " cpu_seconds=" << counters.mSeconds
+                << " mean_score=" << (ran ? counters.mScore / ran : 0)
+                << std::endl;
+        }
+    }
+
+    private:
+    struct Counters
+    {
+        std::atomic<size_t> mRan = 0;
+        std::atomic<size_t> mGated = 0;
+        std::atomic<size_t> mSolved = 0;
+        std::atomic<double> mScore = 0;
+        std::atomic<double> mSeconds = 0;
+    };
+
+    std::vector<PipelineStageSpec> mStages;
+    std::vector<Counters> mCounters;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include "neighbours.h"
+#include "vectors.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// Finishes a nearly valid configuration with Gauss-Newton steps instead of descent epochs.
+// The contacts that matter - pairs violated or within mActiveMargin of contact (cos theta 0.5 when
+// kissing) - are held as equalities x_a.x_b = contact along with |x_p|^2 = 1 for every point they touch. Each step is the
+// least norm correction J^T (J J^T)^-1 (-c) for those constraints, so near a solution the worst
+// overlap falls quadratically, where the descent creeps down it at a fixed step.
+struct PolishParams
+{
+    // Polishing is tried once the worst overlap is below this, 0 never polishes
+    double mStartViolation = 0.05;
+    // Pairs this close to contact are held at contact
+    double mActiveMargin = 1e-4;
+    size_t mMaxIterations = 20;
+    // The solve is dense, so larger active sets are left to the descent
+    size_t mMaxConstraints = 1500;
+};
+
+// Overlap and norm error a polished configuration is accepted at, well inside CalcScore's 1e-9
+static constexpr double PolishTolerance = 1e-12;
+
+// Solves a x = b for symmetric positive definite n x n a (row major), overwriting a with its
+// Cholesky factor and b with x. False if a is not numerically positive definite.
+inline bool CholeskySolve(std::vector<double> & a, std::vector<double> & b, size_t n)
+{
+    for (size_t col = 0; col < n; col++)
+    {
+        auto * rowCol = &a[col * n];
+        double diag = rowCol[col];
+        for (size_t k = 0; k < col; k++)
+        {
+            diag -= rowCol[k] * rowCol[k];
+        }
+        if (!(diag > 0))
+        {
+            return false;
+        }
+        rowCol[col] = std::sqrt(diag);
+        auto invDiag = 1 / rowCol[col];
+
+        for (size_t row = col + 1; row < n; row++)
+        {
+            auto * rowRow = &a[row * n];
+            double val = rowRow[col];
+            for (size_t k = 0; k < col; k++)
+            {
+                val -= rowRow[k] * rowCol[k];
+            }
+            rowRow[col] = val * invDiag;
+        }
+    }
+
+    // L y = b, then L^T x = y
+    for (size_t row = 0; row < n; row++)
+    {
+        for (size_t k = 0; k < row; k++)
+        {
+            b[row] -= a[row * n + k] * b[k];
+        }
+        b[row] /= a[row * n + row];
+    }
+    for (size_t row = n; row-- > 0;)
+    {
+        for (size_t k = row + 1; k < n; k++)
+        {
+            b[row] -= a[k * n + row] * b[k];
+        }
+        b[row] /= a[row * n + row];
+    }
+
+    return true;
+}
+
+// Polishes state in place if it can reach a valid configuration, otherwise leaves it untouched.
+template <size_t Dim>
+bool Polish(std::vector<Vector<Dim>> & state, PolishParams const & params, double contact = 0.5)
+{
+    // A row's gradient is nonzero in at most two points' coordinates
+    struct Row
+    {
+        PointId mA;
+        PointId mB;
+        double mResidual;
+    };
+
+    auto nPoints = state.size();
+    std::vector<Vector<Dim>> unit(state);
+    Normalize(unit, 1);
+    NeighboursLookup neighbourLookup;
+
+    std::vector<Vector<Dim>> steps(nPoints);
+    std::vector<Row> rows;
+    std::vector<int> normRow(nPoints);
+    std::vector<double> gram;
+    std::vector<double> lambdas;
+    // Rows for norms use mB == NormRow and gradient 2 x_a
+    static constexpr PointId NormRow = std::numeric_limits<PointId>::max();
+
+    for (size_t iteration = 0; iteration <= params.mMaxIterations; iteration++)
+    {
+        // Steps can be large on a poorly conditioned contact graph, so pairs are found afresh
+        neighbourLookup = ConstructPointNeighbours(unit, NeighbourMarginFor(contact));
+        rows.clear();
+        double worst = 0;
+        for (PointId pointId = 0; pointId < nPoints; pointId++)
+        {
+            for (PointId neighbourId : neighbourLookup[pointId])
+            {
+                auto residual = Dot(unit[pointId], unit[neighbourId]) - contact;
+                worst = std::max(worst, residual);
+                if (residual > -params.mActiveMargin)
+                {
+                    rows.push_back(Row{pointId, neighbourId, residual});
+                }
+            }
+        }
+
+        std::fill(normRow.begin(), normRow.end(), 0);
+        for (auto const & row : rows)
+        {
+            normRow[row.mA] = normRow[row.mB] = 1;
+        }
+        for (PointId pointId = 0; pointId < nPoints; pointId++)
+        {
+            if (normRow[pointId])
+            {
+                auto residual = Dot(unit[pointId], unit[pointId]) - 1;
+                worst = std::max(worst, std::abs(residual));
+                rows.push_back(Row{pointId, NormRow, residual});
+            }
+        }
+
+        if (worst <= PolishTolerance)
+        {
+            for (PointId pointId = 0; pointId < nPoints; pointId++)
+            {
+                for (size_t j = 0; j < Dim; j++)
+                {
+                    state[pointId].mValues[j] = unit[pointId].mValues[j] * ScaledOne;
+                }
+            }
+            return true;
+        }
+
+        auto n = rows.size();
+        if (iteration == params.mMaxIterations || n > params.mMaxConstraints)
+        {
+            return false;
+        }
+
+        // Dot of row r's gradient with respect to point p and row s's with respect to point q
+        auto gradDot = [&](Row const & r, PointId p, Row const & s, PointId q) {
+            auto const & gr = r.mB == NormRow ? unit[r.mA] : unit[p == r.mA ? r.mB : r.mA];
+            auto const & gs = s.mB == NormRow ? unit[s.mA] : unit[q == s.mA ? s.mB : s.mA];
+            double scale = (r.mB == NormRow ? 2 : 1) * (s.mB == NormRow ? 2 : 1);
+            return scale * Dot(gr, gs);
+        };
+
+        // J J^T - rows only meet where they share a point
+        gram.assign(n * n, 0);
+        for (size_t r = 0; r < n; r++)
+        {
+            auto const & rowR = rows[r];
+            for (size_t s = 0; s <= r; s++)
+            {
+                auto const & rowS = rows[s];
+                double val = 0;
+                for (auto p : {rowR.mA, rowR.mB})
+                {
+                    if (p == NormRow)
+                    {
+                        continue;
+                    }
+                    for (auto q : {rowS.mA, rowS.mB})
+                    {
+                        if (p == q)
+                        {
+                            val += gradDot(rowR, p, rowS, q);
+                        }
+                    }
+                }
+                gram[r * n + s] = gram[s * n + r] = val;
+            }
+        }
+
+        // A touch of damping for contact graphs with dependent constraints
+        for (size_t r = 0; r < n; r++)
+        {
+            gram[r * n + r] *= 1 + 1e-10;
+            gram[r * n + r] += 1e-14;
+        }
+
+        lambdas.resize(n);
+        for (size_t r = 0; r < n; r++)
+        {
+            lambdas[r] = -rows[r].mResidual;
+        }
+        if (!CholeskySolve(gram, lambdas, n))
+        {
+            return false;
+        }
+
+        // x += J^T lambda
+        for (auto & step : steps)
+        {
+            step.Zero();
+        }
+        for (size_t r = 0; r < n; r++)
+        {
+            auto const & row = rows[r];
+            if (row.mB == NormRow)
+            {
+                SubMult(steps[row.mA], unit[row.mA], -2 * lambdas[r]);
+            }
+            else
+            {
+                SubMult(steps[row.mA], unit[row.mB], -lambdas[r]);
+                SubMult(steps[row.mB], unit[row.mA], -lambdas[r]);
+            }
+        }
+        for (PointId pointId = 0; pointId < nPoints; pointId++)
+        {
+            Acc(unit[pointId], steps[pointId]);
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "engine_result.h"
+#include "kernel_dispatch.h"
+#include "neighbours.h"
+#include <algorithm>
+#include <chrono>
+#include <optional>
+
+// How far a configuration is from kissing (or from contact cos theta in general): the summed
+// overlap CalcScore reports, and the worst single pair's
+struct Violation
+{
+    double mScore;
+    double mMax;
+};
+
+template <size_t Dim>
+KISSING_KERNEL Violation CalcViolation(std::vector<Vector<Dim>> const & state, NeighboursLookup const & neighbourLookup, double contact = 0.5)
+{
+    Violation ret{0, 0};
+    for (PointId pointId = 0; pointId < state.size(); pointId++)
+    {
+        for (PointId neighbourId : neighbourLookup[pointId])
+        {
+            auto dotVal = Dot(state[pointId], state[neighbourId]) / ScaledOneSquared;
+            if (dotVal > contact + 1e-9)
+            {
+                ret.mScore += (dotVal - contact);
+                ret.mMax = std::max(ret.mMax, dotVal - contact);
+            }
+        }
+    }
+
+    return ret;
+}
+
+struct StagnationParams
+{
+    // Epochs between checks. A check costs about one inner iteration.
+    size_t mCheckEpochs = 10;
+    // Weight of the newest check in the smoothed score and worst overlap
+    double mSmoothing = 0.2;
+    // A seed is abandoned once neither its smoothed score nor its smoothed worst overlap has
+    // improved by mMinImprovement (relative) for mPatience epochs. 0 never abandons.
+    size_t mPatience = 2000;
+    double mMinImprovement = 0.01;
+    // Wall clock limit per seed in seconds, 0 for none
+    double mMaxSeconds = 0;
+};
+
+// Per seed plateau detection and time guard for a descent. Feed it the violation every
+// CheckEpochs() epochs; it says when to give up.
+class ProgressTracker
+{
+    public:
+    explicit ProgressTracker(StagnationParams const & params)
+        : mParams(params)
+        , mStart(std::chrono::steady_clock::now())
+    {
+    }
+
+    bool Due(size_t epoch) const
+    {
+        return epoch % mParams.mCheckEpochs == 0;
+    }
+
+    std::optional<Termination> Check(size_t epoch, Violation const & violation)
+    {
+        if (mChecks++ == 0)
+        {
+            mScore = mBestScore = violation.mScore;
+            mMax = mBestMax = violation.mMax;
+            mLastImprovement = epoch;
+        }
+        else
+        {
+            mScore += mParams.mSmoothing * (violation.mScore - mScore);
+            mMax += mParams.mSmoothing * (violation.mMax - mMax);
+        }
+
+        auto improved = [&](double smoothed, double & best) {
+            if (smoothed < best * (1 - mParams.mMinImprovement))
+            {
+                best = smoothed;
+                return true;
+            }
+            return false;
+        };
+        // Both are updated, so no short circuit
+        if (improved(mScore, mBestScore) | improved(mMax, mBestMax))
+        {
+            mLastImprovement = epoch;
+        }
+
+        // A seed sitting at zero is still settling onto a valid configuration, let it converge
+        if (mParams.mPatience > 0 && violation.mScore > 0 && epoch - mLastImprovement >= mParams.mPatience)
+        {
+            return Termination::Plateau;
+        }
+
+        if (mParams.mMaxSeconds > 0)
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - mStart;
+            if (elapsed.count() > mParams.mMaxSeconds)
+            {
+                return Termination::TimeLimit;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    private:
+    StagnationParams mParams;
+    std::chrono::steady_clock::time_point mStart;
+    size_t mChecks = 0;
+    size_t mLastImprovement = 0;
+    double mScore = 0;
+    double mMax = 0;
+    double mBestScore = 0;
+    double mBestMax = 0;
+};
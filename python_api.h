@@ -0,0 +1,163 @@
+#pragma once
+
+#include "seed_runner.h"
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <utility>
+
+// Dimension-erased entry points behind the Python module (kissing_module.cpp). Configurations
+// cross the boundary as row-major (points x Dim) doubles, which is exactly the layout of a
+// std::vector<Vector<Dim>>. Engines resize and reorder configurations in place, so inputs are
+// copied in once, while results are handed out without a copy - the vector is moved to the heap
+// and the caller frees it through mRelease when the array viewing it goes away.
+using SupportedDims = std::index_sequence<2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 16, 24>;
+
+template <size_t Dim>
+static constexpr bool PackedVector = sizeof(Vector<Dim>) == Dim * sizeof(PointType) && std::is_same_v<PointType, double>;
+
+// Calls func(std::integral_constant<size_t, Dim>) for the matching supported Dim
+template <typename Func, size_t... Dims>
+void WithDim(size_t dim, Func && func, std::index_sequence<Dims...>)
+{
+    bool found = ((dim == Dims ? (func(std::integral_constant<size_t, Dims>{}), true) : false) || ...);
+    ASSERT_MSG(found, "dimension {} is not compiled in", dim);
+}
+
+template <typename Func>
+void WithDim(size_t dim, Func && func)
+{
+    WithDim(dim, std::forward<Func>(func), SupportedDims{});
+}
+
+struct PointBuffer
+{
+    using ReleaseFunc = void (*)(void *) noexcept;
+
+    double * mData;
+    size_t mNPoints;
+    size_t mDim;
+    // Owns mData
+    void * mOwner;
+    ReleaseFunc mRelease;
+};
+
+template <size_t Dim>
+PointBuffer ReleasePoints(std::vector<Vector<Dim>> && points)
+{
+    static_assert(PackedVector<Dim>);
+
+    auto * owner = new std::vector<Vector<Dim>>(std::move(points));
+    auto release = [](void * ptr) noexcept { delete static_cast<std::vector<Vector<Dim>> *>(ptr); };
+    // No points has no first point to take the coordinates of
+    auto * data = owner->empty() ? nullptr : owner->front().mValues.data();
+    return PointBuffer{data, owner->size(), Dim, owner, release};
+}
+
+template <size_t Dim>
+std::vector<Vector<Dim>> CopyPoints(double const * data, size_t nPoints)
+{
+    static_assert(PackedVector<Dim>);
+
+    std::vector<Vector<Dim>> ret(nPoints);
+    std::memcpy(ret.data(), data, nPoints * sizeof(Vector<Dim>));
+    return ret;
+}
+
+inline PointBuffer InitializePoints(size_t dim, size_t nBalls, uint64_t seed, SeedOptions const & seedOptions)
+{
+    PointBuffer ret{};
+    WithDim(dim, [&](auto dimConstant) {
+        static constexpr size_t Dim = decltype(dimConstant)::value;
+        Philox4x32 rand(seed);
+        auto state = InitializeSeed<Dim>(seedOptions, nBalls, rand);
+        Normalize(state, ScaledOne);
+        ret = ReleasePoints(std::move(state));
+    });
+    return ret;
+}
+
+inline double ScorePoints(double const * data, size_t nPoints, size_t dim, double contact = 0.5)
+{
+    double ret = 0;
+    WithDim(dim, [&](auto dimConstant) {
+        static constexpr size_t Dim = decltype(dimConstant)::value;
+        auto state = CopyPoints<Dim>(data, nPoints);
+        ret = ScoreAtContact(state, contact);
+    });
+    return ret;
+}
+
+struct RunOutcome
+{
+    PointBuffer mPoints;
+    EngineResult mResult;
+};
+
+// Runs an engine on a given configuration. seed drives the engines that use randomness.
+inline RunOutcome RunEngine(double const * data, size_t nPoints, size_t dim, EngineOptions const & engineOptions, uint64_t seed, size_t budget)
+{
+    RunOutcome ret{};
+    WithDim(dim, [&](auto dimConstant) {
+        static constexpr size_t Dim = decltype(dimConstant)::value;
+        auto state = CopyPoints<Dim>(data, nPoints);
+        Philox4x32 rand(seed);
+        NoOutput noOutput;
+        WithEngine(engineOptions, [&](auto const & engine) {
+            ret.mResult = engine.template Run<Dim>(state, rand, noOutput, budget);
+        });
+        ret.mPoints = ReleasePoints(std::move(state));
+    });
+    return ret;
+}
+
+// Seeds firstSeed..lastSeed on nThreads C++ threads, same as the batch mode. Results are in seed order.
+// The first thread's exception, if any, is rethrown once every thread has stopped, and stops the
+// others taking new seeds.
+inline std::vector<WorkResult> RunBatch(size_t dim, size_t nBalls, size_t firstSeed, size_t lastSeed, EngineOptions const & engineOptions, RunOptions const & options, size_t nThreads)
+{
+    ASSERT_MSG(firstSeed <= lastSeed && nThreads > 0, "empty batch");
+
+    std::vector<WorkResult> ret(lastSeed - firstSeed + 1);
+    WithDim(dim, [&](auto dimConstant) {
+        static constexpr size_t Dim = decltype(dimConstant)::value;
+        WithEngine(engineOptions, [&](auto const & engine) {
+            std::atomic<size_t> nextSeed{firstSeed};
+            std::vector<std::exception_ptr> errors(nThreads);
+            auto work = [&](size_t threadIdx) {
+                try
+                {
+                    NoOutput noOutput;
+                    std::vector<Vector<Dim>> state;
+                    for (size_t seed = nextSeed++; seed <= lastSeed; seed = nextSeed++)
+                    {
+                        ret[seed - firstSeed] = RunSeed<Dim>(engine, options, seed, nBalls, noOutput, state);
+                    }
+                }
+                catch (...)
+                {
+                    errors[threadIdx] = std::current_exception();
+                    nextSeed = lastSeed + 1;
+                }
+            };
+
+            {
+                std::vector<std::jthread> threads;
+                for (size_t i = 1; i < nThreads; i++)
+                {
+                    threads.emplace_back(work, i);
+                }
+                work(0);
+            }
+
+            for (auto const & error : errors)
+            {
+                if (error)
+                {
+                    std::rethrow_exception(error);
+                }
+            }
+        });
+    });
+    return ret;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "types.h"
+#include <algorithm>
+#include <numeric>
+#include <tuple>
+#include <unistd.h>
+
+// Sorts points along a Morton (Z-order) curve over their coordinates so that neighbours on the
+// sphere sit close together in memory. Once the points, pushes and magnitudes outgrow L2 the
+// neighbour accesses in the pair loop are otherwise effectively random.
+// Keeps the map back to the original ids so frames and the final state come out unpermuted.
+template <size_t Dim>
+class LocalityOrder
+{
+    public:
+    // Points drift slowly, so the order only needs refreshing occasionally
+    static constexpr size_t ReorderEpochs = 64;
+    // Bits per coordinate in the 64 bit key
+    static constexpr size_t KeyBits = std::min<size_t>(21, 64 / Dim);
+
+    static bool Worthwhile(size_t nPoints)
+    {
+        // Points, pushes and magnitudes are all touched through the neighbour lists
+        auto workingSet = nPoints * (2 * sizeof(Vector<Dim>) + 2 * sizeof(PointType));
+        return workingSet > L2CacheBytes();
+    }
+
+    static size_t L2CacheBytes()
+    {
+        static size_t const bytes = [] {
+            auto size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+            return size > 0 ? static_cast<size_t>(size) : size_t(1) << 20;
+        }();
+        return bytes;
+    }
+
+    explicit LocalityOrder(size_t nPoints) : mOriginalIds(nPoints)
+    {
+        std::iota(mOriginalIds.begin(), mOriginalIds.end(), PointId(0));
+    }
+
+    // Permutes state and diffs together into curve order
+    void Reorder(std::vector<Vector<Dim>> & state, std::vector<Vector<Dim>> & diffs)
+    {
+        auto nPoints = state.size();
+        mKeys.resize(nPoints);
+        // Ties go by original id, so the new order depends only on the positions and not on the
+        // order they arrive in - a descent resumed from a keyframe reorders exactly as the original
+        for (PointId pointId = 0; pointId < nPoints; pointId++)
+        {
+            mKeys[pointId] = {MortonKey(state[pointId]), mOriginalIds[pointId], pointId};
+        }
+        std::sort(mKeys.begin(), mKeys.end());
+
+        Permute(state);
+        Permute(diffs);
+
+        mScratchIds.resize(nPoints);
+        for (PointId newId = 0; newId < nPoints; newId++)
+        {
+            mScratchIds[newId] = std::get<1>(mKeys[newId]);
+        }
+        std::swap(mOriginalIds, mScratchIds);
+    }
+
+    // state laid out by original id. Valid until the next call.
+    std::vector<Vector<Dim>> const & InOriginalOrder(std::vector<Vector<Dim>> const & state)
+    {
+        mScratch.resize(state.size());
+        for (PointId pointId = 0; pointId < state.size(); pointId++)
+        {
+            mScratch[mOriginalIds[pointId]] = state[pointId];
+        }
+        return mScratch;
+    }
+
+    // Puts state back into original id order
+    void Restore(std::vector<Vector<Dim>> & state)
+    {
+        InOriginalOrder(state);
+        std::swap(state, mScratch);
+        std::iota(mOriginalIds.begin(), mOriginalIds.end(), PointId(0));
+    }
+
+    private:
+    static uint64_t MortonKey(Vector<Dim> const & point)
+    {
+        static constexpr uint64_t Cells = uint64_t(1) << KeyBits;
+
+        // Coordinates of points near the sphere lie in [-1, 1]
+        std::array<uint64_t, Dim> cells;
+        for (size_t d = 0; d < Dim; d++)
+        {
+            auto unit = (point.mValues[d] / ScaledOne + 1) * 0.5;
+            cells[d] = static_cast<uint64_t>(std::clamp(unit * Cells, 0.0, Cells - 1.0));
+        }
+
+        uint64_t key = 0;
+        for (size_t bit = KeyBits; bit-- > 0;)
+        {
+            for (size_t d = 0; d < Dim; d++)
+            {
+                key = (key << 1) | ((cells[d] >> bit) & 1);
+            }
+        }
+        return key;
+    }
+
+    void Permute(std::vector<Vector<Dim>> & vectors)
+    {
+        mScratch.resize(vectors.size());
+        for (PointId newId = 0; newId < vectors.size(); newId++)
+        {
+            mScratch[newId] = vectors[std::get<2>(mKeys[newId])];
+        }
+        std::swap(vectors, mScratch);
+    }
+
+    std::vector<PointId> mOriginalIds;
+    std::vector<PointId> mScratchIds;
+    // Morton key, original id, current id
+    std::vector<std::tuple<uint64_t, PointId, PointId>> mKeys;
+    std::vector<Vector<Dim>> mScratch;
+};
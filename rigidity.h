@@ -0,0 +1,384 @@
+#pragma once
+
+#include "neighbours.h"
+#include "vectors.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// First order rigidity of a configuration's contact graph. The contacts are the pairs within
+// mContactMargin of contact or overlapping, each a constraint x_a.x_b = contact. Points are moved
+// only along their sphere's tangent space (Dim - 1 coordinates each), so the rigidity matrix R has
+// a row per contact and a column per tangent coordinate, with row (a, b) holding T_a^T x_b and
+// T_b^T x_a. Its null space is every motion keeping all contacts to first order: the global
+// rotations, which are always there, plus the flexes. With no flexes the configuration is
+// infinitesimally rigid - a jammed configuration that more descent will not unjam. Rattlers, points
+// held by too few contacts to pin them, are dropped first so they do not count as flexes.
+//
+// The descent's contacts overlap, and at large overlaps the graph is over-constrained and reads
+// rigid while the descent is still unloading it, so a run only counts as jammed once it is rigid
+// and its score has also stopped falling.
+struct RigidityParams
+{
+    // Epochs between analyses during a descent, 0 never analyses
+    size_t mEveryEpochs = 0;
+    // Leave the descent this long before the first analysis - early graphs are still forming
+    size_t mMinEpochs = 1000;
+    // A rigid run is jammed if its score fell by less than this fraction since the last analysis
+    double mMinImprovement = 0.01;
+    // Pairs this close below contact count as contacts
+    double mContactMargin = 1e-3;
+    // Singular values below this fraction of the largest are zero
+    double mRankTolerance = 1e-6;
+    // Largest single point move of a push along a flex, in radians, and pushes per seed
+    double mFlexStep = 0.01;
+    size_t mMaxFlexPushes = 4;
+    // The SVD is dense and cubic, so larger graphs are not analysed
+    size_t mMaxColumns = 600;
+    size_t mMaxContacts = 3000;
+};
+
+template <size_t Dim>
+struct RigidityReport
+{
+    size_t mContacts = 0;
+    size_t mRattlers = 0;
+    size_t mRank = 0;
+    size_t mFlexes = 0;
+    // False if the graph was over the size limits, and nothing past the counts was found
+    bool mAnalysed = true;
+    // The first flex as a displacement of every point (zero for rattlers), if there is one
+    std::vector<Vector<Dim>> mFlex;
+
+    bool Jammed() const
+    {
+        return mAnalysed && mContacts > 0 && mFlexes == 0;
+    }
+};
+
+// One-sided Jacobi SVD of the rows x cols row major matrix a. Rotates pairs of columns until
+// they are orthogonal, so afterwards column j's norm is singular value j and v (cols x cols, row
+// major) holds the right singular vectors as columns. Returns the singular values.
+inline std::vector<double> JacobiSvd(std::vector<double> & a, size_t rows, size_t cols, std::vector<double> & v)
+{
+    static constexpr size_t MaxSweeps = 60;
+    static constexpr double Orthogonal = 1e-15;
+
+    v.assign(cols * cols, 0);
+    for (size_t j = 0; j < cols; j++)
+    {
+        v[j * cols + j] = 1;
+    }
+
+    for (size_t sweep = 0; sweep < MaxSweeps; sweep++)
+    {
+        bool rotated = false;
+        for (size_t p = 0; p + 1 < cols; p++)
+        {
+            for (size_t q = p + 1; q < cols; q++)
+            {
+                double alpha = 0;
+                double beta = 0;
+                double gamma = 0;
+                for (size_t i = 0; i < rows; i++)
+                {
+                    auto ap = a[i * cols + p];
+                    auto aq = a[i * cols + q];
+                    alpha += ap * ap;
+                    beta += aq * aq;
+                    gamma += ap * aq;
+                }
+                if (std::abs(gamma) <= Orthogonal * std::sqrt(alpha * beta))
+                {
+                    continue;
+                }
+                rotated = true;
+
+                auto zeta = (beta - alpha) / (2 * gamma);
+                auto t = std::copysign(1.0, zeta) / (std::abs(zeta) + std::sqrt(1 + zeta * zeta));
+                auto c = 1 / std::sqrt(1 + t * t);
+                auto s = c * t;
+                auto rotate = [&](std::vector<double> & m, size_t nRows) {
+                    for (size_t i = 0; i < nRows; i++)
+                    {
+                        auto mp = m[i * cols + p];
+                        auto mq = m[i * cols + q];
+                        m[i * cols + p] = c * mp - s * mq;
+                        m[i * cols + q] = s * mp + c * mq;
+                    }
+                };
+                rotate(a, rows);
+                rotate(v, cols);
+            }
+        }
+
+        if (!rotated)
+        {
+            break;
+        }
+    }
+
+    std::vector<double> ret(cols);
+    for (size_t j = 0; j < cols; j++)
+    {
+        for (size_t i = 0; i < rows; i++)
+        {
+            ret[j] += a[i * cols + j] * a[i * cols + j];
+        }
+        ret[j] = std::sqrt(ret[j]);
+    }
+    return ret;
+}
+
+// Orthonormal basis of the tangent space at unit x: the standard axes, less the one x leans on
+// most, with x and each other projected out
+template <size_t Dim>
+std::array<Vector<Dim>, Dim - 1> TangentBasis(Vector<Dim> const & x)
+{
+    size_t skip = 0;
+    for (size_t j = 1; j < Dim; j++)
+    {
+        if (std::abs(x.mValues[j]) > std::abs(x.mValues[skip]))
+        {
+            skip = j;
+        }
+    }
+
+    std::array<Vector<Dim>, Dim - 1> ret;
+    size_t k = 0;
+    for (size_t axis = 0; axis < Dim; axis++)
+    {
+        if (axis == skip)
+        {
+            continue;
+        }
+        auto & t = ret[k];
+        t.Zero();
+        t.mValues[axis] = 1;
+        SubMult(t, x, Dot(t, x));
+        for (size_t prev = 0; prev < k; prev++)
+        {
+            SubMult(t, ret[prev], Dot(t, ret[prev]));
+        }
+        Normalize(t, 1);
+        k++;
+    }
+    return ret;
+}
+
+template <size_t Dim>
+RigidityReport<Dim> AnalyseRigidity(std::vector<Vector<Dim>> const & state, NeighboursLookup const & neighbourLookup, double contact, RigidityParams const & params)
+{
+    static constexpr size_t TangentDim = Dim - 1;
+    auto nPoints = state.size();
+    std::vector<Vector<Dim>> unit(state);
+    Normalize(unit, 1);
+
+    struct Contact
+    {
+        PointId mA;
+        PointId mB;
+    };
+    std::vector<Contact> contacts;
+    for (PointId pointId = 0; pointId < nPoints; pointId++)
+    {
+        for (PointId neighbourId : neighbourLookup[pointId])
+        {
+            if (Dot(unit[pointId], unit[neighbourId]) > contact - params.mContactMargin)
+            {
+                contacts.push_back(Contact{pointId, neighbourId});
+            }
+        }
+    }
+
+    // A point needs at least Dim contacts to be pinned in its Dim - 1 tangent directions.
+    // Dropping one rattler can free its neighbours, so repeat until none are left.
+    std::vector<bool> rattler(nPoints, false);
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        std::vector<size_t> degree(nPoints, 0);
+        for (auto const & c : contacts)
+        {
+            if (!rattler[c.mA] && !rattler[c.mB])
+            {
+                degree[c.mA]++;
+                degree[c.mB]++;
+            }
+        }
+        for (PointId pointId = 0; pointId < nPoints; pointId++)
+        {
+            if (!rattler[pointId] && degree[pointId] < Dim)
+            {
+                rattler[pointId] = true;
+                changed = true;
+            }
+        }
+    }
+    std::erase_if(contacts, [&](Contact const & c) { return rattler[c.mA] || rattler[c.mB]; });
+
+    RigidityReport<Dim> ret;
+    ret.mContacts = contacts.size();
+    ret.mRattlers = std::count(rattler.begin(), rattler.end(), true);
+    if (contacts.empty())
+    {
+        return ret;
+    }
+
+    // Columns for the tangent coordinates of the points that are not rattlers
+    std::vector<size_t> column(nPoints, 0);
+    std::vector<std::array<Vector<Dim>, TangentDim>> bases(nPoints);
+    size_t cols = 0;
+    for (PointId pointId = 0; pointId < nPoints; pointId++)
+    {
+        if (!rattler[pointId])
+        {
+            column[pointId] = cols;
+            cols += TangentDim;
+            bases[pointId] = TangentBasis(unit[pointId]);
+        }
+    }
+    if (cols > params.mMaxColumns || contacts.size() > params.mMaxContacts)
+    {
+        ret.mAnalysed = false;
+        return ret;
+    }
+
+    auto rows = std::max(contacts.size(), cols);
+    std::vector<double> rigidity(rows * cols, 0);
+    for (size_t r = 0; r < contacts.size(); r++)
+    {
+        auto const & c = contacts[r];
+        for (size_t k = 0; k < TangentDim; k++)
+        {
+            rigidity[r * cols + column[c.mA] + k] = Dot(bases[c.mA][k], unit[c.mB]);
+            rigidity[r * cols + column[c.mB] + k] = Dot(bases[c.mB][k], unit[c.mA]);
+        }
+    }
+
+    std::vector<double> v;
+    auto singular = JacobiSvd(rigidity, rows, cols, v);
+    auto tolerance = params.mRankTolerance * *std::max_element(singular.begin(), singular.end());
+
+    // Rotations in each coordinate plane, in tangent coordinates - always in the null space,
+    // orthonormalised so they can be projected out of it
+    auto project = [&](std::vector<double> & motion, std::vector<std::vector<double>> const & basis) {
+        for (auto const & b : basis)
+        {
+            double dot = 0;
+            for (size_t j = 0; j < cols; j++)
+            {
+                dot += motion[j] * b[j];
+            }
+            for (size_t j = 0; j < cols; j++)
+            {
+                motion[j] -= dot * b[j];
+            }
+        }
+        double norm = 0;
+        for (auto value : motion)
+        {
+            norm += value * value;
+        }
+        return std::sqrt(norm);
+    };
+    auto addIfIndependent = [&](std::vector<double> motion, std::vector<std::vector<double>> & basis) {
+        auto norm = project(motion, basis);
+        if (norm > 1e-6)
+        {
+            for (auto & value : motion)
+            {
+                value /= norm;
+            }
+            basis.push_back(std::move(motion));
+            return true;
+        }
+        return false;
+    };
+
+    std::vector<std::vector<double>> trivial;
+    for (size_t i = 0; i < Dim; i++)
+    {
+        for (size_t j = i + 1; j < Dim; j++)
+        {
+            std::vector<double> motion(cols, 0);
+            for (PointId pointId = 0; pointId < nPoints; pointId++)
+            {
+                if (rattler[pointId])
+                {
+                    continue;
+                }
+                Vector<Dim> omegaX;
+                omegaX.Zero();
+                omegaX.mValues[i] = unit[pointId].mValues[j];
+                omegaX.mValues[j] = -unit[pointId].mValues[i];
+                for (size_t k = 0; k < TangentDim; k++)
+                {
+                    motion[column[pointId] + k] = Dot(bases[pointId][k], omegaX);
+                }
+            }
+            addIfIndependent(std::move(motion), trivial);
+        }
+    }
+
+    auto basis = trivial;
+    for (size_t j = 0; j < cols; j++)
+    {
+        if (singular[j] > tolerance)
+        {
+            ret.mRank++;
+            continue;
+        }
+
+        std::vector<double> nullVector(cols);
+        for (size_t i = 0; i < cols; i++)
+        {
+            nullVector[i] = v[i * cols + j];
+        }
+        if (addIfIndependent(std::move(nullVector), basis))
+        {
+            ret.mFlexes++;
+        }
+    }
+
+    if (ret.mFlexes > 0)
+    {
+        auto const & flex = basis[trivial.size()];
+        ret.mFlex.assign(nPoints, Vector<Dim>{});
+        for (PointId pointId = 0; pointId < nPoints; pointId++)
+        {
+            ret.mFlex[pointId].Zero();
+            if (rattler[pointId])
+            {
+                continue;
+            }
+            for (size_t k = 0; k < TangentDim; k++)
+            {
+                SubMult(ret.mFlex[pointId], bases[pointId][k], -flex[column[pointId] + k]);
+            }
+        }
+    }
+
+    return ret;
+}
+
+// Moves state along flex so that no point moves more than step radians
+template <size_t Dim>
+void PushAlongFlex(std::vector<Vector<Dim>> & state, std::vector<Vector<Dim>> const & flex, double step)
+{
+    double largest = 0;
+    for (auto const & move : flex)
+    {
+        largest = std::max(largest, std::sqrt(Dot(move, move)));
+    }
+    if (largest == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < state.size(); i++)
+    {
+        SubMult(state[i], flex[i], -step / largest * ScaledOne);
+    }
+    Normalize(state, ScaledOne);
+}
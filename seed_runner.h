@@ -0,0 +1,32 @@
+#pragma once
+
+#include "engines.h"
+#include "lattice_seeds.h"
+#include "options.h"
+#include "philox.h"
+#include "warm_start.h"
+#include "work_result.h"
+#include <chrono>
+
+// One seed from start to finish: initial configuration, warm start, then the engine. Leaves the
+// final configuration in state.
+template <size_t Dim, typename EngineT, typename OutputT>
+    requires Engine<EngineT, Dim, Philox4x32, OutputT>
+WorkResult RunSeed(EngineT const & engine, RunOptions const & options, size_t seed, size_t nBalls, OutputT & output, std::vector<Vector<Dim>> & state)
+{
+    auto startTime = std::chrono::steady_clock::now();
+
+    Philox4x32 rand(seed);
+    state = InitializeSeed<Dim>(options.mSeed, nBalls, rand);
+
+    ASSERT(state.size() == nBalls);
+    Normalize(state, ScaledOne);
+    WarmStart(state, options.mWarmStartSteps);
+
+    auto startScore = ScoreAtContact(state, EngineContact(engine));
+
+    auto result = engine.template Run<Dim>(state, rand, output, options.mBudget);
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+    return WorkResult{seed, startScore, result.mScore, result.mEpochs, elapsed.count(), result.mTermination};
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "debug_output.h"
+#include "work_result.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// Work ledger shared by batch workers on one machine. The seed range is cut into shards, each
+// of which is free, leased to a worker until some time, or done. Workers claim a free or expired
+// shard, renew the lease while they run it and mark it done once its results file is in place,
+// so the shards of a worker that crashes are handed out again when its leases run out.
+//
+// Every read-modify-write holds an flock on <ledger>.lock, and the ledger itself is replaced by
+// rename, so a crash mid-update leaves the previous version intact.
+struct Shard
+{
+    enum class State
+    {
+        Free,
+        Leased,
+        Done,
+    };
+
+    size_t mFirstSeed;
+    // Inclusive
+    size_t mLastSeed;
+    State mState = State::Free;
+    std::string mOwner = "-";
+    // Unix seconds
+    int64_t mLeaseExpiry = 0;
+};
+
+struct LedgerStatus
+{
+    size_t mFree = 0;
+    size_t mLeased = 0;
+    size_t mExpired = 0;
+    size_t mDone = 0;
+};
+
+class ShardLedger
+{
+    public:
+    explicit ShardLedger(std::string path) : mPath(std::move(path))
+    {
+    }
+
+    // Writes a fresh ledger covering firstSeed..lastSeed. Refuses to replace an existing one.
+    void Create(size_t firstSeed, size_t lastSeed, size_t shardSeeds, int64_t leaseSeconds)
+    {
+        ASSERT_MSG(shardSeeds > 0 && leaseSeconds > 0, "shard size and lease must be positive");
+        ASSERT_MSG(firstSeed <= lastSeed, "empty seed range {}..{}", firstSeed, lastSeed);
+
+        LedgerLock lock(mPath);
+        ASSERT_MSG(!std::filesystem::exists(mPath), "ledger {} already exists", mPath);
+
+        mLeaseSeconds = leaseSeconds;
+        mShards.clear();
+        for (size_t first = firstSeed; first <= lastSeed; first += shardSeeds)
+        {
+            mShards.push_back(Shard{first, std::min(lastSeed, first + shardSeeds - 1)});
+            if (lastSeed - first < shardSeeds)
+            {
+                break;
+            }
+        }
+        Save();
+    }
+
+    // Leases the first free or expired shard to owner
+    std::optional<Shard> Claim(std::string const & owner)
+    {
+        LedgerLock lock(mPath);
+        Load();
+
+        auto now = Now();
+        for (auto & shard : mShards)
+        {
+            if (shard.mState == Shard::State::Free || (shard.mState == Shard::State::Leased && shard.mLeaseExpiry <= now))
+            {
+                shard.mState = Shard::State::Leased;
+                shard.mOwner = owner;
+                shard.mLeaseExpiry = now + mLeaseSeconds;
+                Save();
+                return shard;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Extends a lease the owner still holds. Returns false if it was lost to another worker.
+    bool Renew(Shard const & claimed, std::string const & owner)
+    {
+        LedgerLock lock(mPath);
+        Load();
+
+        auto & shard = Find(claimed);
+        if (shard.mState != Shard::State::Leased || shard.mOwner != owner)
+        {
+            return false;
+        }
+
+        shard.mLeaseExpiry = Now() + mLeaseSeconds;
+        Save();
+        return true;
+    }
+
+    // Marks a shard done even if its lease has since passed on - the results are as good either way
+    void Complete(Shard const & claimed, std::string const & owner)
+    {
+        LedgerLock lock(mPath);
+        Load();
+
+        auto & shard = Find(claimed);
+        shard.mState = Shard::State::Done;
+        shard.mOwner = owner;
+        shard.mLeaseExpiry = 0;
+        Save();
+    }
+
+    LedgerStatus Status()
+    {
+        LedgerLock lock(mPath);
+        Load();
+
+        LedgerStatus ret;
+        auto now = Now();
+        for (auto const & shard : mShards)
+        {
+            switch (shard.mState)
+            {
+                case Shard::State::Free: ret.mFree++; break;
+                case Shard::State::Leased: (shard.mLeaseExpiry <= now ? ret.mExpired : ret.mLeased)++; break;
+                case Shard::State::Done: ret.mDone++; break;
+            }
+        }
+        return ret;
+    }
+
+    // Lease length, as of the last claim or update
+    int64_t LeaseSeconds() const
+    {
+        return mLeaseSeconds;
+    }
+
+    // Identifies this process to other workers
+    static std::string ProcessOwner()
+    {
+        char host[256] = {};
+        gethostname(host, sizeof(host) - 1);
+        return std::string(host) + ":" + std::to_string(getpid());
+    }
+
+    private:
+    // Exclusive flock on <ledger>.lock for the lifetime of the object
+    class LedgerLock
+    {
+        public:
+        explicit LedgerLock(std::string const & ledgerPath)
+        {
+            auto lockPath = ledgerPath + ".lock";
+            mFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            ASSERT_MSG(mFd >= 0, "could not open {}", lockPath);
+            ASSERT_MSG(flock(mFd, LOCK_EX) == 0, "could not lock {}", lockPath);
+        }
+
+        LedgerLock(LedgerLock const &) = delete;
+        LedgerLock & operator=(LedgerLock const &) = delete;
+
+        ~LedgerLock()
+        {
+            flock(mFd, LOCK_UN);
+            close(mFd);
+        }
+
+        private:
+        int mFd;
+    };
+
+    static int64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    Shard & Find(Shard const & claimed)
+    {
+        for (auto & shard : mShards)
+        {
+            if (shard.mFirstSeed == claimed.mFirstSeed && shard.mLastSeed == claimed.mLastSeed)
+            {
+                return shard;
+            }
+        }
+
+        ASSERT_MSG(false, "shard {}..{} is not in {}", claimed.mFirstSeed, claimed.mLastSeed, mPath);
+        return mShards.front();
+    }
+
+    static char const * StateName(Shard::State state)
+    {
+        switch (state)
+        {
+            case Shard::State::Free: return "free";
+            case Shard::State::Leased: return "leased";
+            case Shard::State::Done: return "done";
+        }
+        return "";
+    }
+
+    static Shard::State ParseState(std::string const & name)
+    {
+        if (name == "free") { return Shard::State::Free; }
+        if (name == "leased") { return Shard::State::Leased; }
+        if (name == "done") { return Shard::State::Done; }
+
+        ASSERT_MSG(false, "unknown shard state {}", name);
+        return Shard::State::Free;
+    }
+
+    // lease_seconds <n>
+    // shard <first> <last> <state> <owner> <expiry>
+    void Load()
+    {
+        std::ifstream in(mPath);
+        ASSERT_MSG(in, "could not read ledger {}", mPath);
+
+        std::string key;
+        in >> key >> mLeaseSeconds;
+        ASSERT_MSG(key == "lease_seconds", "{} is not a ledger", mPath);
+
+        mShards.clear();
+        std::string state;
+        Shard shard{};
+        while (in >> key >> shard.mFirstSeed >> shard.mLastSeed >> state >> shard.mOwner >> shard.mLeaseExpiry)
+        {
+            shard.mState = ParseState(state);
+            mShards.push_back(shard);
+        }
+    }
+
+    void Save()
+    {
+        auto tmpPath = mPath + ".tmp." + std::to_string(getpid());
+        {
+            std::ofstream out(tmpPath);
+            out << "lease_seconds " << mLeaseSeconds << "\n";
+            for (auto const & shard : mShards)
+            {
+                out << "shard " << shard.mFirstSeed << " " << shard.mLastSeed << " " << StateName(shard.mState) << " " << shard.mOwner << " " << shard.mLeaseExpiry << "\n";
+            }
+            out.flush();
+            ASSERT_MSG(out, "could not write {}", tmpPath);
+        }
+        std::filesystem::rename(tmpPath, mPath);
+    }
+
+    std::string mPath;
+    int64_t mLeaseSeconds = 0;
+    std::vector<Shard> mShards;
+};
+
+// Renews a claimed shard's lease every quarter lease from its own thread until destroyed, so the
+// lease holds however long single seeds take. A lost lease is reported and not renewed again.
+class LeaseHeartbeat
+{
+    public:
+    LeaseHeartbeat(std::string const & ledgerPath, Shard const & shard, std::string const & owner, int64_t leaseSeconds)
+        : mThread([=](std::stop_token stop) { Beat(ledgerPath, shard, owner, std::chrono::seconds(std::max<int64_t>(1, leaseSeconds / 4)), stop); })
+    {
+    }
+
+    private:
+    static void Beat(std::string const & ledgerPath, Shard const & shard, std::string const & owner, std::chrono::seconds interval, std::stop_token stop)
+    {
+        // Its own ledger object - the ledger's flock serialises it against the worker's
+        ShardLedger ledger(ledgerPath);
+        std::mutex mutex;
+        std::condition_variable_any wake;
+        std::unique_lock lock(mutex);
+        while (!wake.wait_for(lock, stop, interval, [&] { return stop.stop_requested(); }))
+        {
+            if (!ledger.Renew(shard, owner))
+            {
+                std::cerr << "Lost lease on seeds " << shard.mFirstSeed << ".." << shard.mLastSeed << std::endl;
+                return;
+            }
+        }
+    }
+
+    std::jthread mThread;
+};
+
+// Where a worker leaves a shard's results. Written under a temporary name and renamed into place,
+// so merging never sees half a shard.
+inline std::filesystem::path ShardResultsPath(std::filesystem::path const & dir, Shard const & shard)
+{
+    return dir / ("seeds_" + std::to_string(shard.mFirstSeed) + "_" + std::to_string(shard.mLastSeed) + ".txt");
+}
+
+// Every result in dir's shard files, sorted by seed. Seeds run twice (a lease that expired while
+// its worker was still going) keep the result from the first file by name, so merges agree
+// whatever order the directory lists in.
+inline std::vector<WorkResult> MergeShardResults(std::filesystem::path const & dir)
+{
+    std::vector<std::filesystem::path> shardFiles;
+    for (auto const & entry : std::filesystem::directory_iterator(dir))
+    {
+        auto name = entry.path().filename().string();
+        if (name.starts_with("seeds_") && entry.path().extension() == ".txt")
+        {
+            shardFiles.push_back(entry.path());
+        }
+    }
+    std::sort(shardFiles.begin(), shardFiles.end());
+
+    std::vector<WorkResult> ret;
+    for (auto const & path : shardFiles)
+    {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            if (auto result = ParseResult(line))
+            {
+                ret.push_back(*result);
+            }
+        }
+    }
+
+    std::stable_sort(ret.begin(), ret.end(), [](auto const & a, auto const & b) { return a.mSeed < b.mSeed; });
+    ret.erase(std::unique(ret.begin(), ret.end(), [](auto const & a, auto const & b) { return a.mSeed == b.mSeed; }), ret.end());
+    return ret;
+}
@@ -10,6 +10,9 @@
 #include "file_output.h"
 #include "initial_states.h"
 #include "vectors.h"
+#include "neighbours.h"
+#include "engine_result.h"
+#include "dot_gradient_descent.h"
 #include <stdint.h>
 #include <random>
 
@@ -86,119 +89,86 @@ bool AcceptTransition(double oldEnergy, double newEnergy, double temperature, Ra
     else
     {
         std::uniform_real_distribution<double> realDistn(0, 1);
-        return realDistn(rand) < std::exp(-(newEnergy - oldEnergy) / (temperature));
+        return DrawUniform(rand, realDistn) < std::exp(-(newEnergy - oldEnergy) / (temperature));
     }
 }
 
 
 
 
+static constexpr auto MOVE_DIST = ScaledOne / 32;
+
+// Proposes moving a single random ball and applies it if the Metropolis test passes.
+// Returns whether the move was accepted.
 template <size_t Dim, typename Rand>
-void RunInnerLoop(std::vector<Vector<Dim>> & state, NeighboursLookup const & neighbourLookup, double temperature, Rand & rand)
+bool TryMove(std::vector<Vector<Dim>> & state, NeighboursLookup const & neighbourLookup, double temperature, std::uniform_int_distribution<size_t> & intDistn, Rand & rand)
 {
-    // Let's ballpark a number of iterations whilst it's safe to not update neigbour lookup
-    // Lets say each ball moves N times - that makes it move in each dimension a gaussian
-    // with variance sqrt(N) * MoveDist.
-    // The square magnitude of our vector is a chi squared distribution with parameter Dim
-    // This has variance 2*Dim * sqrt(N) * MoveDist - Let's crudely approx as normal and say
-    // We want something stepping out of the 0.2 move bounary to be a 5 sigma event
-    // So we have 
-    // 5 sigma = 0.1
-    // -> sigma = 0.5 
-    // -> variance = root(2) / 2
-    // -> Sqrt(N) = root(2) / (2 * 2 * Dim * MoveDist)
-    // -> N = 1 / 2 * Dim^2 * MoveDist ^ 2
-
-    constexpr auto MOVE_DIST = ScaledOne / 32;
-    // static constexpr auto RecipMoveDist = ScaledOne / MOVE_DIST;
-    // static constexpr auto SafeIterations = RecipMoveDist * RecipMoveDist / Dim / Dim / 2;
-    static constexpr auto SafeIterations = 1;
-
-
-    std::uniform_int_distribution<size_t> intDistn(0, state.size() - 1);
+    auto randomEl = intDistn(rand);
+    auto & stateEl = state[randomEl];
+    auto orthRandomMove = RandPoint<Dim>(MOVE_DIST, rand);
+    // auto orthComp = Dot(orthRandomMove, stateEl) / ScaledOne;
+    // auto mag = Dot(stateEl, stateEl) / ScaledOne;
 
-    for (size_t innerEpoch = 0; innerEpoch < SafeIterations; innerEpoch++)
-        {
-            auto randomEl = intDistn(rand);
-            auto & stateEl = state[randomEl];
-            auto orthRandomMove = RandPoint<Dim>(MOVE_DIST, rand);
-            // auto orthComp = Dot(orthRandomMove, stateEl) / ScaledOne;
-            // auto mag = Dot(stateEl, stateEl) / ScaledOne;
 
+    // for (size_t j = 0; j < Dim; j++)
+    // {
+    //     orthRandomMove.mValues[j] -= (stateEl.mValues[j] * orthComp) / mag;
+    // }
 
-            // for (size_t j = 0; j < Dim; j++)
-            // {
-            //     orthRandomMove.mValues[j] -= (stateEl.mValues[j] * orthComp) / mag;
-            // }
+    // std::cout << Dot(orthRandomMove, stateEl) << std::endl;
 
-            // std::cout << Dot(orthRandomMove, stateEl) << std::endl;
+    auto oldEnergy = EnergyContrib(state, neighbourLookup, randomEl, stateEl);
+    auto newPoint = Add(stateEl, orthRandomMove);
+    auto newEnergy = EnergyContrib(state, neighbourLookup, randomEl, newPoint);
 
-            auto oldEnergy = EnergyContrib(state, neighbourLookup, randomEl, stateEl);
-            auto newPoint = Add(stateEl, orthRandomMove);
-            auto newEnergy = EnergyContrib(state, neighbourLookup, randomEl, newPoint);
+    if (AcceptTransition(oldEnergy, newEnergy, temperature, rand))
+    {
+        stateEl = newPoint;
+        return true;
+    }
 
-            if (AcceptTransition(oldEnergy, newEnergy, temperature, rand))
-            {
-                stateEl = newPoint;
-            }
-        }
+    return false;
 }
 
-
-template <size_t Dim, typename Rand> 
-bool RunAnnealing(std::vector<Vector<Dim>> & initialState, Rand & rand)
+template <size_t Dim, typename Rand, typename OutputT> 
+EngineResult RunAnnealing(std::vector<Vector<Dim>> & initialState, Rand & rand, OutputT & frameOutput, size_t CoolingRounds)
 {
-    FileOutput frameOutput("viewer/frames.json");
     auto & state = initialState;
-    // static constexpr size_t OuterEpochs = 100;
 
     auto neighbourLookup = ConstructPointNeighboursBidi(state, ScaledBound(1.2));    
     auto systemEnergy = Energy(state, neighbourLookup);
-    std::cout << "System started with energy of " << systemEnergy << std::endl;
     // Allow a 1/4 increase in temp with probability 1/e
     double const initialTemperature = systemEnergy / 16; // 16;// / 16 / 4;
     auto temperature = initialTemperature;// initialTemperature;
 
     static constexpr auto InitialIters = 100000;
 
+    std::uniform_int_distribution<size_t> intDistn(0, state.size() - 1);
+
     // Let's just run the simulation a bit to quickly drop out of the really high initial temp.
     // Really high initial temp probably leads to some large movements so 
-    for (size_t i = 0; i < 100; i++)
+    for (size_t round = 0; round < CoolingRounds; round++)
     {
         for (size_t i = 0; i < InitialIters; i++)
         {
-            neighbourLookup = ConstructPointNeighboursBidi(state, ScaledBound(1.2));
-            RunInnerLoop(state, neighbourLookup, temperature, rand);
+            // Rebuilding every move made this O(N^2) per move - a ball only drifts ~MOVE_DIST per
+            // accepted move, so once per N moves is well inside the 1.2 margin
+            if (i % state.size() == 0)
+            {
+                neighbourLookup = ConstructPointNeighboursBidi(state, ScaledBound(1.2));
+            }
+            TryMove(state, neighbourLookup, temperature, intDistn, rand);
             // This is not a good plan
             // Normalize(state, ScaledOne);
             // frameOutput.WriteRow(state);
         }
 
-        systemEnergy = Energy(state, neighbourLookup);
-        std::cout << "After initial " << InitialIters << " rounds, system energy is " << systemEnergy << std::endl;
         frameOutput.WriteRow(state);
         temperature *= 7;
         temperature /= 8;
     }
 
-    
-
-    // std::uniform_int_distribution<size_t> intDistn(0, state.size() - 1);
-
-    // for (size_t outerEpoch = 0; outerEpoch < OuterEpochs; outerEpoch++)
-    // {
-    //     DEBUG_LOG_VECTS(state);
-    //     frameOutput.WriteRow(state);
-    //     neighbourLookup = ConstructPointNeighboursBidi(state, ScaledBound(1.2));
-
-        
-
-        
-    // }
-
-    
-    // printf("Finished found after %lu iterations:\n", OuterEpochs);
-    // PrintVects(state);
-
-    return false;
-}
\ No newline at end of file
+    Normalize(state, ScaledOne);
+    auto scoreLookup = ConstructPointNeighbours(state);
+    return EngineResult{CalcScore(state, scoreLookup), CoolingRounds};
+}
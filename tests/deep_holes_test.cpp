@@ -0,0 +1,40 @@
+#include "deep_holes.h"
+#include "initial_states.h"
+#include <cmath>
+#include <iostream>
+
+// Climbs held at the end sharpness, where the soft maximum's exponents reach about -8000,
+// must still weigh every point finitely and non-negatively
+int main()
+{
+    auto rand = Philox4x32(1);
+    auto points = Initialize<4>(24, 1, rand);
+    Normalize(points, 1);
+
+    HoleSearchParams params;
+    params.mStartSharpness = params.mEndSharpness;
+
+    std::vector<double> weights;
+    for (size_t climb = 0; climb < 32; climb++)
+    {
+        auto direction = RandPointOnSphere<4>(1, rand);
+        Normalize(direction, 1);
+        ClimbToHole(points, direction, params, weights);
+
+        for (auto weight : weights)
+        {
+            if (!std::isfinite(weight) || weight < 0)
+            {
+                std::cerr << "climb " << climb << " weighed a point at " << weight << std::endl;
+                return 1;
+            }
+        }
+        if (!std::isfinite(Dot(direction, direction)))
+        {
+            std::cerr << "climb " << climb << " left a direction of " << Dot(direction, direction) << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
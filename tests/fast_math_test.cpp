@@ -0,0 +1,40 @@
+#include "fast_math.h"
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+// FastExp against std::exp across its range, and 0 / +inf / NaN past either end of it
+int main()
+{
+    int failures = 0;
+    auto check = [&](bool ok, char const * what, double x, double got) {
+        if (!ok)
+        {
+            std::cerr << what << " at " << x << ": got " << got << ", std::exp gives " << std::exp(x) << std::endl;
+            failures++;
+        }
+    };
+
+    for (double x = -708; x <= 709.78; x += 0.0137)
+    {
+        auto got = FastExp(x);
+        check(std::abs(got - std::exp(x)) <= 1e-14 * std::exp(x), "relative error over 1e-14", x, got);
+    }
+
+    auto inf = std::numeric_limits<double>::infinity();
+    for (double x : {-708.01, -708.5, -709.0, -745.2, -800.0, -1e4, -1e300, -inf})
+    {
+        auto got = FastExp(x);
+        check(got == 0 && !std::signbit(got), "not +0 below the range", x, got);
+    }
+    for (double x : {709.79, 709.9, 710.0, 710.01, 711.0, 1e4, 1e300, inf})
+    {
+        auto got = FastExp(x);
+        check(got == inf, "not +inf above the range", x, got);
+    }
+
+    auto nan = std::numeric_limits<double>::quiet_NaN();
+    check(std::isnan(FastExp(nan)), "NaN not kept", nan, FastExp(nan));
+
+    return failures == 0 ? 0 : 1;
+}
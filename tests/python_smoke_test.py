@@ -0,0 +1,19 @@
+# Imports the kissing module from the build directory (first argument) and runs a tiny batch
+import sys
+
+sys.path.insert(0, sys.argv[1])
+import kissing
+
+results = kissing.run_batch(4, 24, 1, 4, budget=200, threads=2)
+assert [result[0] for result in results] == [1, 2, 3, 4], results
+assert all(result[2] >= 0 and result[3] > 0 for result in results), results
+
+points = kissing.initialize(4, 24, seed=1)
+assert points.shape == (24, 4), points.shape
+points, score, epochs = kissing.run(points, budget=100)
+assert points.shape == (24, 4) and score >= 0 and epochs > 0, (score, epochs)
+assert abs(kissing.calc_score(points) - score) < 1e-9, (kissing.calc_score(points), score)
+
+empty = kissing.initialize(4, 0, seed=1)
+assert empty.shape == (0, 4), empty.shape
+assert kissing.calc_score(points, contact=0.6) <= kissing.calc_score(points)
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <immintrin.h>
+
+// Barrier for threads that are all busy on the same configuration - phases are tens of
+// microseconds, so spin briefly before falling back to a futex wait.
+class SpinBarrier
+{
+    public:
+    SpinBarrier(size_t nThreads) : mCount(nThreads)
+    {
+    }
+
+    void ArriveAndWait()
+    {
+        auto phase = mPhase.load(std::memory_order_acquire);
+        if (mArrived.fetch_add(1, std::memory_order_acq_rel) + 1 == mCount)
+        {
+            mArrived.store(0, std::memory_order_relaxed);
+            mPhase.fetch_add(1, std::memory_order_release);
+            mPhase.notify_all();
+            return;
+        }
+
+        static constexpr size_t SpinLimit = 4096;
+        for (size_t spin = 0; spin < SpinLimit; spin++)
+        {
+            if (mPhase.load(std::memory_order_acquire) != phase)
+            {
+                return;
+            }
+            _mm_pause();
+        }
+
+        while (mPhase.load(std::memory_order_acquire) == phase)
+        {
+            mPhase.wait(phase, std::memory_order_acquire);
+        }
+    }
+
+    private:
+    size_t mCount;
+    alignas(64) std::atomic<size_t> mArrived{0};
+    alignas(64) std::atomic<size_t> mPhase{0};
+};
+
+// Fixed set of threads that all run the same task, for splitting one configuration across cores.
+// The calling thread takes part as thread 0. Tasks can synchronise phases with Barrier().
+class ThreadPool
+{
+    public:
+    ThreadPool(size_t nThreads) : mBarrier(nThreads)
+    {
+        for (size_t threadIdx = 1; threadIdx < nThreads; threadIdx++)
+        {
+            mThreads.emplace_back([this, threadIdx]{ WorkerLoop(threadIdx); });
+        }
+    }
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool & operator=(ThreadPool const &) = delete;
+
+    ~ThreadPool()
+    {
+        mStopping = true;
+        mGeneration.fetch_add(1, std::memory_order_release);
+        mGeneration.notify_all();
+
+        for (auto & thread : mThreads)
+        {
+            thread.join();
+        }
+    }
+
+    size_t Size() const
+    {
+        return mThreads.size() + 1;
+    }
+
+    SpinBarrier & Barrier()
+    {
+        return mBarrier;
+    }
+
+    // Runs task(threadIdx) on every thread and returns once they have all finished
+    template <typename Task>
+    void RunOnAll(Task & task)
+    {
+        mTaskContext = &task;
+        mTaskFunc = [](void * context, size_t threadIdx) { (*static_cast<Task *>(context))(threadIdx); };
+        mRemaining.store(mThreads.size(), std::memory_order_relaxed);
+
+        mGeneration.fetch_add(1, std::memory_order_release);
+        mGeneration.notify_all();
+
+        task(0);
+
+        size_t remaining;
+        while ((remaining = mRemaining.load(std::memory_order_acquire)) != 0)
+        {
+            mRemaining.wait(remaining, std::memory_order_acquire);
+        }
+    }
+
+    private:
+    void WorkerLoop(size_t threadIdx)
+    {
+        size_t seenGeneration = 0;
+        while (true)
+        {
+            mGeneration.wait(seenGeneration, std::memory_order_acquire);
+            seenGeneration = mGeneration.load(std::memory_order_acquire);
+
+            if (mStopping)
+            {
+                return;
+            }
+
+            mTaskFunc(mTaskContext, threadIdx);
+
+            if (mRemaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                mRemaining.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> mThreads;
+    SpinBarrier mBarrier;
+    void * mTaskContext{};
+    void (*mTaskFunc)(void *, size_t){};
+    std::atomic<bool> mStopping{false};
+    alignas(64) std::atomic<size_t> mGeneration{0};
+    alignas(64) std::atomic<size_t> mRemaining{0};
+};
@@ -0,0 +1,366 @@
+#pragma once
+
+#include "dot_gradient_descent.h"
+#include "debug_output.h"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// Sub-sampled search trajectories for the ML dataset. Each worker records every Nth frame of
+// its seeds (positions, per-point step size, score) and hands finished seeds to a single writer
+// thread, which packs them into compressed column shards so the workers never wait on disk.
+//
+// Shard layout (little endian), readable with ml/trajectories.py:
+//   "KSTRAJ1\0", u32 column count, then per column
+//     u16 name length, name, u8 dtype (0 u64, 1 f64, 2 f32), u8 rank, u64 shape[rank],
+//     u64 compressed bytes, zlib compressed row-major data
+// Columns: seed, final_score (per seed), frame_offset (seeds + 1 - frames of seed i are rows
+// frame_offset[i] .. frame_offset[i + 1]), frame, score (per frame), points (frames x balls x dim),
+// step_size (frames x balls).
+// Shards are named traj_<first seed>_<last seed>_<host>_<pid>.kst, so workers can share a
+// directory. manifest.json lists every worker's shards - each adds its own as they close, holding
+// an flock on manifest.json.lock while it rereads and rewrites (by rename) the manifest.
+struct TrajectoryRecord
+{
+    uint64_t mSeed;
+    double mFinalScore;
+    std::vector<uint64_t> mFrames;
+    std::vector<double> mScores;
+    std::vector<float> mPoints;
+    std::vector<float> mStepSizes;
+};
+
+class TrajectoryExporter
+{
+    public:
+    TrajectoryExporter(std::filesystem::path dir, size_t dim, size_t nBalls, size_t frameStride, size_t seedsPerShard)
+        : mDir(std::move(dir))
+        , mDim(dim)
+        , mNBalls(nBalls)
+        , mFrameStride(frameStride)
+        , mSeedsPerShard(seedsPerShard)
+    {
+        ASSERT_MSG(frameStride > 0 && seedsPerShard > 0, "export stride and shard size must be positive");
+        std::filesystem::create_directories(mDir);
+
+        char host[256] = {};
+        gethostname(host, sizeof(host) - 1);
+        mOwner = std::string(host) + "_" + std::to_string(getpid());
+
+        mWriter = std::thread([this]{ WriterLoop(); });
+    }
+
+    TrajectoryExporter(TrajectoryExporter const &) = delete;
+    TrajectoryExporter & operator=(TrajectoryExporter const &) = delete;
+
+    ~TrajectoryExporter()
+    {
+        {
+            std::scoped_lock lock{mMutex};
+            mStopping = true;
+        }
+        mWake.notify_one();
+        mWriter.join();
+    }
+
+    size_t FrameStride() const
+    {
+        return mFrameStride;
+    }
+
+    void Submit(TrajectoryRecord && record)
+    {
+        {
+            std::scoped_lock lock{mMutex};
+            mPending.push_back(std::move(record));
+        }
+        mWake.notify_one();
+    }
+
+    private:
+    struct ShardInfo
+    {
+        std::string mFile;
+        uint64_t mFirstSeed;
+        uint64_t mLastSeed;
+        size_t mSeeds;
+        size_t mFrames;
+        size_t mBytes;
+    };
+
+    void WriterLoop()
+    {
+        std::vector<TrajectoryRecord> shard;
+        while (true)
+        {
+            std::deque<TrajectoryRecord> batch;
+            bool stopping;
+            {
+                std::unique_lock lock{mMutex};
+                mWake.wait(lock, [this]{ return mStopping || !mPending.empty(); });
+                std::swap(batch, mPending);
+                stopping = mStopping;
+            }
+
+            for (auto & record : batch)
+            {
+                shard.push_back(std::move(record));
+                if (shard.size() == mSeedsPerShard)
+                {
+                    WriteShard(shard);
+                    shard.clear();
+                }
+            }
+
+            if (stopping)
+            {
+                if (!shard.empty())
+                {
+                    WriteShard(shard);
+                }
+                return;
+            }
+        }
+    }
+
+    enum class DType : uint8_t
+    {
+        U64 = 0,
+        F64 = 1,
+        F32 = 2,
+    };
+
+    template <typename T>
+    static void WritePod(std::ofstream & out, T value)
+    {
+        out.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    static void WriteColumn(std::ofstream & out, std::string const & name, DType dtype, std::vector<uint64_t> const & shape, std::vector<T> const & values)
+    {
+        auto rawBytes = values.size() * sizeof(T);
+        auto bound = compressBound(rawBytes);
+        std::vector<Bytef> compressed(bound);
+        auto status = compress2(compressed.data(), &bound, reinterpret_cast<Bytef const *>(values.data()), rawBytes, Z_DEFAULT_COMPRESSION);
+        ASSERT_MSG(status == Z_OK, "zlib failed compressing {}", name);
+
+        WritePod(out, static_cast<uint16_t>(name.size()));
+        out.write(name.data(), name.size());
+        WritePod(out, dtype);
+        WritePod(out, static_cast<uint8_t>(shape.size()));
+        for (auto extent : shape)
+        {
+            WritePod(out, extent);
+        }
+        WritePod(out, static_cast<uint64_t>(bound));
+        out.write(reinterpret_cast<char const *>(compressed.data()), bound);
+    }
+
+    void WriteShard(std::vector<TrajectoryRecord> const & records)
+    {
+        std::vector<uint64_t> seeds;
+        std::vector<double> finalScores;
+        std::vector<uint64_t> frameOffsets{0};
+        std::vector<uint64_t> frames;
+        std::vector<double> scores;
+        std::vector<float> points;
+        std::vector<float> stepSizes;
+        for (auto const & record : records)
+        {
+            seeds.push_back(record.mSeed);
+            finalScores.push_back(record.mFinalScore);
+            frames.insert(frames.end(), record.mFrames.begin(), record.mFrames.end());
+            frameOffsets.push_back(frames.size());
+            scores.insert(scores.end(), record.mScores.begin(), record.mScores.end());
+            points.insert(points.end(), record.mPoints.begin(), record.mPoints.end());
+            stepSizes.insert(stepSizes.end(), record.mStepSizes.begin(), record.mStepSizes.end());
+        }
+
+        auto [first, last] = std::minmax_element(seeds.begin(), seeds.end());
+        auto name = "traj_" + std::to_string(*first) + "_" + std::to_string(*last) + "_" + mOwner + ".kst";
+        auto path = mDir / name;
+        auto tmpPath = path;
+        tmpPath += ".tmp";
+        {
+            std::ofstream out(tmpPath, std::ios::binary);
+            out.write("KSTRAJ1", 8);
+            WritePod(out, static_cast<uint32_t>(7));
+            uint64_t nFrames = frames.size();
+            WriteColumn(out, "seed", DType::U64, {seeds.size()}, seeds);
+            WriteColumn(out, "final_score", DType::F64, {seeds.size()}, finalScores);
+            WriteColumn(out, "frame_offset", DType::U64, {frameOffsets.size()}, frameOffsets);
+            WriteColumn(out, "frame", DType::U64, {nFrames}, frames);
+            WriteColumn(out, "score", DType::F64, {nFrames}, scores);
+            WriteColumn(out, "points", DType::F32, {nFrames, mNBalls, mDim}, points);
+            WriteColumn(out, "step_size", DType::F32, {nFrames, mNBalls}, stepSizes);
+            out.flush();
+            ASSERT_MSG(out, "could not write {}", tmpPath.string());
+        }
+        std::filesystem::rename(tmpPath, path);
+
+        AddToManifest(ShardInfo{name, *first, *last, seeds.size(), frames.size(), std::filesystem::file_size(path)});
+    }
+
+    // Rereads the manifest under its lock and rewrites it with shard added, keeping every other
+    // worker's entries. Entries are one per line, as written here.
+    void AddToManifest(ShardInfo const & shard)
+    {
+        auto path = mDir / "manifest.json";
+        auto lockPath = mDir / "manifest.json.lock";
+        auto lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        ASSERT_MSG(lockFd >= 0, "could not open {}", lockPath.string());
+        ASSERT_MSG(flock(lockFd, LOCK_EX) == 0, "could not lock {}", lockPath.string());
+
+        std::ostringstream header;
+        header << "{\n  \"format\": \"kstraj1\",\n  \"dim\": " << mDim << ",\n  \"balls\": " << mNBalls
+               << ",\n  \"frame_stride\": " << mFrameStride << ",\n  \"shards\": [";
+
+        std::vector<std::string> entries;
+        if (std::ifstream in(path); in)
+        {
+            std::string existing((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            ASSERT_MSG(existing.starts_with(header.str()), "{} was written for another dim, ball count or stride", path.string());
+
+            std::istringstream lines(existing);
+            std::string line;
+            while (std::getline(lines, line))
+            {
+                if (line.starts_with("    {\"file\": "))
+                {
+                    if (line.ends_with(","))
+                    {
+                        line.pop_back();
+                    }
+                    entries.push_back(line);
+                }
+            }
+        }
+
+        std::ostringstream entry;
+        entry << "    {\"file\": \"" << shard.mFile << "\", \"first_seed\": " << shard.mFirstSeed << ", \"last_seed\": " << shard.mLastSeed
+              << ", \"seeds\": " << shard.mSeeds << ", \"frames\": " << shard.mFrames << ", \"bytes\": " << shard.mBytes << "}";
+        entries.push_back(entry.str());
+
+        auto tmpPath = path;
+        tmpPath += ".tmp." + mOwner;
+        {
+            std::ofstream out(tmpPath);
+            out << header.str();
+            bool first = true;
+            for (auto const & line : entries)
+            {
+                out << (first ? "\n" : ",\n") << line;
+                first = false;
+            }
+            out << "\n  ]\n}\n";
+            out.flush();
+            ASSERT_MSG(out, "could not write {}", tmpPath.string());
+        }
+        std::filesystem::rename(tmpPath, path);
+
+        flock(lockFd, LOCK_UN);
+        close(lockFd);
+    }
+
+    std::filesystem::path mDir;
+    size_t mDim;
+    size_t mNBalls;
+    size_t mFrameStride;
+    size_t mSeedsPerShard;
+    // <host>_<pid>, naming this process's shards
+    std::string mOwner;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::deque<TrajectoryRecord> mPending;
+    bool mStopping = false;
+    std::thread mWriter;
+};
+
+// Frame output that samples every FrameStride()th frame of the current seed for the exporter,
+// then forwards all frames. Does nothing extra without an exporter. Steps and scores are taken
+// with the run's descent constants and contact.
+template <size_t Dim, typename OutputT>
+class TrajectoryRecorder
+{
+    public:
+    TrajectoryRecorder(OutputT & inner, TrajectoryExporter * exporter, LossKind loss, DescentParams const & descent, double contact)
+        : mInner(inner), mExporter(exporter), mLoss(loss), mLossClamp(descent.mLossClamp), mStep(descent.Step(contact))
+    {
+    }
+
+    void StartSeed(uint64_t seed)
+    {
+        mRecord = TrajectoryRecord{seed, 0, {}, {}, {}, {}};
+        mNextFrame = 0;
+    }
+
+    void FinishSeed(std::vector<Vector<Dim>> const & finalState, double finalScore)
+    {
+        if (!mExporter)
+        {
+            return;
+        }
+
+        // Always keep the end point, unless the last sample already was it
+        if (mRecord.mFrames.empty() || mRecord.mFrames.back() + 1 != mNextFrame)
+        {
+            Sample(finalState, mNextFrame);
+        }
+        mRecord.mFinalScore = finalScore;
+        mExporter->Submit(std::move(mRecord));
+    }
+
+    void WriteRow(std::vector<Vector<Dim>> const & row)
+    {
+        if (mExporter && mNextFrame % mExporter->FrameStride() == 0)
+        {
+            Sample(row, mNextFrame);
+        }
+        mNextFrame++;
+        mInner.WriteRow(row);
+    }
+
+    private:
+    // Positions, score and the size of each point's next descent step
+    void Sample(std::vector<Vector<Dim>> const & state, uint64_t frame)
+    {
+        auto neighbours = ConstructPointNeighbours(state, NeighbourMarginFor(mStep.mContact, mStep.mNeighbourMargin));
+        mSteps.resize(state.size());
+        WithLoss(mLoss, [&](auto lossFunc) {
+            CalcDotDiffs<Dim>(state, neighbours, mSteps, SteppedLoss<decltype(lossFunc)>{lossFunc, mStep});
+        }, mLossClamp);
+
+        mRecord.mFrames.push_back(frame);
+        mRecord.mScores.push_back(CalcScore(state, neighbours, mStep.mContact));
+        for (size_t i = 0; i < state.size(); i++)
+        {
+            for (auto coord : state[i].mValues)
+            {
+                mRecord.mPoints.push_back(static_cast<float>(coord / ScaledOne));
+            }
+            mRecord.mStepSizes.push_back(static_cast<float>(std::sqrt(Dot(mSteps[i], mSteps[i])) / ScaledOne));
+        }
+    }
+
+    OutputT & mInner;
+    TrajectoryExporter * mExporter;
+    LossKind mLoss;
+    double mLossClamp;
+    PairStep mStep;
+    TrajectoryRecord mRecord;
+    uint64_t mNextFrame = 0;
+    std::vector<Vector<Dim>> mSteps;
+};
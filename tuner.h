@@ -0,0 +1,127 @@
+#pragma once
+
+#include "descent_params.h"
+#include "philox.h"
+#include "work_result.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Tunes the descent's constants for the configuration being searched. Candidates are drawn
+// log-uniformly over ranges around the hand tuned values, then successive halving runs them all
+// on a small sample of seeds, keeps the better half, doubles the sample and repeats until one is
+// left. Every candidate sees the same seeds, so the sample's luck is shared rather than measured.
+// Better is more valid configurations per CPU second, falling back to the lower mean final score
+// while successes are too rare to tell candidates apart.
+struct TuneParams
+{
+    // Candidates drawn, including the starting settings
+    size_t mCandidates = 12;
+    // Seeds each candidate runs in the first round
+    size_t mSeeds = 10;
+    uint64_t mSampleSeed = 1;
+};
+
+struct TuneCandidate
+{
+    DescentParams mParams;
+    size_t mSuccesses = 0;
+    double mSeconds = 0;
+    double mScore = 0;
+    size_t mSeeds = 0;
+
+    double SuccessesPerSecond() const
+    {
+        return mSeconds > 0 ? mSuccesses / mSeconds : 0;
+    }
+
+    double MeanScore() const
+    {
+        return mSeeds ? mScore / mSeeds : 0;
+    }
+
+    bool BetterThan(TuneCandidate const & other) const
+    {
+        if (SuccessesPerSecond() != other.SuccessesPerSecond())
+        {
+            return SuccessesPerSecond() > other.SuccessesPerSecond();
+        }
+        return MeanScore() < other.MeanScore();
+    }
+
+    void Record(std::vector<WorkResult> const & results)
+    {
+        for (auto const & result : results)
+        {
+            mSuccesses += result.mScore == 0;
+            mSeconds += result.mSeconds;
+            mScore += result.mScore;
+            mSeeds++;
+        }
+    }
+};
+
+template <typename Rand>
+DescentParams SampleDescentParams(Rand & rand)
+{
+    std::uniform_real_distribution<double> unit;
+    auto logUniform = [&](double lo, double hi) { return lo * std::pow(hi / lo, DrawUniform(rand, unit)); };
+
+    DescentParams ret;
+    ret.mDelta = logUniform(3e-6, 3e-5);
+    ret.mRampIn = logUniform(2, 12);
+    ret.mQuadDelta = logUniform(0.3, 3);
+    // Below about 1.1 pairs approach faster than the lists are rebuilt
+    ret.mNeighbourMargin = 1.1 + 0.3 * DrawUniform(rand, unit);
+    ret.mLossClamp = logUniform(3e-3, 3e-2);
+    ret.mInnerLoops = static_cast<size_t>(std::round(logUniform(30, 300)));
+    ret.mOuterEpochs = static_cast<size_t>(std::round(logUniform(5, 40))) * 1000;
+    return ret;
+}
+
+inline void PrintCandidate(size_t round, size_t index, TuneCandidate const & candidate, std::ostream & out)
+{
+    out << "round " << round << " candidate " << index
+        << " seeds=" << candidate.mSeeds
+        << " successes=" << candidate.mSuccesses
+        << " cpu_seconds=" << candidate.mSeconds
+        << " successes_per_cpu_second=" << candidate.SuccessesPerSecond()
+        << " mean_score=" << candidate.MeanScore();
+    ForEachDescentField(candidate.mParams, [&](char const * name, auto const & value) { out << " " << name << "=" << value; });
+    out << std::endl;
+}
+
+// Successive halving from start and params.mCandidates - 1 drawn candidates. evaluate(descent,
+// first, last) runs the descent on seeds first..last (inclusive) of the sample, counted from 0.
+// Returns the last candidate standing.
+template <typename Evaluate>
+TuneCandidate TuneDescent(DescentParams const & start, TuneParams const & params, Evaluate && evaluate, std::ostream & out)
+{
+    ASSERT_MSG(params.mCandidates > 0 && params.mSeeds > 0, "tune needs candidates and seeds");
+
+    auto rand = Philox4x32(params.mSampleSeed);
+    std::vector<std::pair<size_t, TuneCandidate>> alive;
+    alive.emplace_back(0, TuneCandidate{start});
+    for (size_t i = 1; i < params.mCandidates; i++)
+    {
+        alive.emplace_back(i, TuneCandidate{SampleDescentParams(rand)});
+    }
+
+    for (size_t round = 0, seeds = params.mSeeds; ; round++, seeds *= 2)
+    {
+        for (auto & [index, candidate] : alive)
+        {
+            candidate.Record(evaluate(candidate.mParams, candidate.mSeeds, seeds - 1));
+            PrintCandidate(round, index, candidate, out);
+        }
+
+        std::stable_sort(alive.begin(), alive.end(), [](auto const & a, auto const & b) { return a.second.BetterThan(b.second); });
+        if (alive.size() <= 2)
+        {
+            return alive.front().second;
+        }
+        alive.resize((alive.size() + 1) / 2);
+    }
+}
@@ -5,14 +5,21 @@
 #include <vector>
 #include <cstring>
 #include <cmath>
+#include <algorithm>
 #include <array>
 
 using PointId = size_t;
 using NeighboursLookup = std::vector<std::vector<PointId>>;
 using PointType = double;
 
+// Vectors whose size is a power of two are aligned to it (up to a cache line), so a 4D vector is
+// one aligned ymm load, an 8D one a single zmm or cache line, and none ever straddles two lines.
+// Sizes are unchanged, so arrays of points stay packed.
 template <size_t Dim>
-struct Vector
+static constexpr size_t VectorAlignment = (Dim & (Dim - 1)) == 0 ? std::min<size_t>(Dim * sizeof(PointType), 64) : alignof(PointType);
+
+template <size_t Dim>
+struct alignas(VectorAlignment<Dim>) Vector
 {
     std::array<PointType, Dim> mValues;
 
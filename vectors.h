@@ -3,7 +3,7 @@
 #include "types.h"
 
 template <size_t Dim>
-PointType Dot (Vector<Dim> const & a, Vector<Dim> const & b)
+constexpr PointType Dot (Vector<Dim> const & a, Vector<Dim> const & b)
 {
     PointType ret = 0;
     for (size_t i = 0; i < Dim; i++)
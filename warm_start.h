@@ -0,0 +1,184 @@
+#pragma once
+
+#include "types.h"
+#include "vectors.h"
+#include <vector>
+
+// Cheap first stage: a few hundred steps of Riesz s-energy repulsion (s = 2) over all pairs to
+// spread a random start out before the thresholded descent. With s = 2 the pair weight is
+// 1 / r^4, so the kernel needs no square roots and vectorises over the inner index.
+// Points are held coordinate-major (one contiguous array per dimension) for the kernel.
+template <size_t Dim>
+class RieszWarmStart
+{
+    public:
+    // Largest distance any point moves in the first step, shrinking linearly to a tenth of that
+    static constexpr PointType InitialStep = ScaledOne / 8;
+    static constexpr size_t Lanes = 4;
+
+    void Run(std::vector<Vector<Dim>> & state, size_t steps)
+    {
+        auto nPoints = state.size();
+        if (steps == 0 || nPoints < 2)
+        {
+            return;
+        }
+
+        Normalize(state, ScaledOne);
+
+        for (auto & coords : mCoords)
+        {
+            coords.resize(nPoints);
+        }
+        for (auto & forces : mForces)
+        {
+            forces.resize(nPoints);
+        }
+
+        for (size_t i = 0; i < nPoints; i++)
+        {
+            for (size_t d = 0; d < Dim; d++)
+            {
+                mCoords[d][i] = state[i].mValues[d];
+            }
+        }
+
+        for (size_t step = 0; step < steps; step++)
+        {
+            auto maxForceSq = CalcForces(nPoints);
+            auto stepSize = InitialStep * (1 - 0.9 * step / steps);
+            ApplyForces(nPoints, stepSize / std::sqrt(maxForceSq + 1e-300));
+        }
+
+        for (size_t i = 0; i < nPoints; i++)
+        {
+            for (size_t d = 0; d < Dim; d++)
+            {
+                state[i].mValues[d] = mCoords[d][i];
+            }
+        }
+    }
+
+    private:
+    // Fills mForces with the tangential part of the repulsion on each point.
+    // Returns the largest squared force.
+    double CalcForces(size_t nPoints)
+    {
+        double maxForceSq = 0;
+        for (size_t i = 0; i < nPoints; i++)
+        {
+            std::array<double, Dim> point;
+            for (size_t d = 0; d < Dim; d++)
+            {
+                point[d] = mCoords[d][i];
+            }
+
+            // Separate partial sums per lane - a plain reduction over j can't be vectorised without
+            // -ffast-math. The i == j term contributes nothing as its difference vector is zero.
+            std::array<std::array<double, Lanes>, Dim> laneForce{};
+            size_t j = 0;
+            for (; j + Lanes <= nPoints; j += Lanes)
+            {
+                std::array<double, Lanes> distSq;
+                for (size_t lane = 0; lane < Lanes; lane++)
+                {
+                    distSq[lane] = 1e-12;
+                }
+                for (size_t d = 0; d < Dim; d++)
+                {
+                    for (size_t lane = 0; lane < Lanes; lane++)
+                    {
+                        auto diff = point[d] - mCoords[d][j + lane];
+                        distSq[lane] += diff * diff;
+                    }
+                }
+
+                std::array<double, Lanes> weight;
+                for (size_t lane = 0; lane < Lanes; lane++)
+                {
+                    weight[lane] = 1 / (distSq[lane] * distSq[lane]);
+                }
+
+                for (size_t d = 0; d < Dim; d++)
+                {
+                    for (size_t lane = 0; lane < Lanes; lane++)
+                    {
+                        laneForce[d][lane] += (point[d] - mCoords[d][j + lane]) * weight[lane];
+                    }
+                }
+            }
+
+            std::array<double, Dim> force{};
+            for (size_t d = 0; d < Dim; d++)
+            {
+                for (size_t lane = 0; lane < Lanes; lane++)
+                {
+                    force[d] += laneForce[d][lane];
+                }
+            }
+
+            for (; j < nPoints; j++)
+            {
+                double distSq = 1e-12;
+                for (size_t d = 0; d < Dim; d++)
+                {
+                    auto diff = point[d] - mCoords[d][j];
+                    distSq += diff * diff;
+                }
+
+                auto weight = 1 / (distSq * distSq);
+                for (size_t d = 0; d < Dim; d++)
+                {
+                    force[d] += (point[d] - mCoords[d][j]) * weight;
+                }
+            }
+
+            double radial = 0;
+            for (size_t d = 0; d < Dim; d++)
+            {
+                radial += force[d] * point[d];
+            }
+
+            double forceSq = 0;
+            for (size_t d = 0; d < Dim; d++)
+            {
+                force[d] -= radial * point[d];
+                forceSq += force[d] * force[d];
+                mForces[d][i] = force[d];
+            }
+
+            maxForceSq = std::max(maxForceSq, forceSq);
+        }
+
+        return maxForceSq;
+    }
+
+    void ApplyForces(size_t nPoints, double scale)
+    {
+        for (size_t i = 0; i < nPoints; i++)
+        {
+            double magSq = 0;
+            for (size_t d = 0; d < Dim; d++)
+            {
+                mCoords[d][i] += mForces[d][i] * scale;
+                magSq += mCoords[d][i] * mCoords[d][i];
+            }
+
+            auto invMag = ScaledOne / std::sqrt(magSq);
+            for (size_t d = 0; d < Dim; d++)
+            {
+                mCoords[d][i] *= invMag;
+            }
+        }
+    }
+
+    std::array<std::vector<double>, Dim> mCoords;
+    std::array<std::vector<double>, Dim> mForces;
+};
+
+template <size_t Dim>
+void WarmStart(std::vector<Vector<Dim>> & state, size_t steps)
+{
+    RieszWarmStart<Dim> warmStart;
+    warmStart.Run(state, steps);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "engine_result.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct WorkResult
+{
+    size_t mSeed;
+    double mStartScore;
+    double mScore;
+    size_t mEpochs;
+    // Wall time the worker spent on this seed - each worker owns a core, so this is CPU time
+    double mSeconds;
+    Termination mTermination = Termination::Budget;
+};
+
+// Scores and times round trip exactly through ParseResult, so merged shards match a single run
+inline void PrintResult(WorkResult const & result, std::ostream & out)
+{
+    auto precision = out.precision(std::numeric_limits<double>::max_digits10);
+    out << "(" << result.mSeed  << "," << result.mStartScore << "," << result.mScore << "," << result.mEpochs << "," << result.mSeconds
+        << ",\"" << TerminationName(result.mTermination) << "\")," << std::endl;
+    out.precision(precision);
+}
+
+// Inverse of PrintResult. Also reads lines from before the termination reason was printed.
+inline std::optional<WorkResult> ParseResult(std::string const & line)
+{
+    WorkResult result;
+    char termination[16] = "budget";
+    auto fields = std::sscanf(line.c_str(), " (%zu,%lf,%lf,%zu,%lf,\"%15[a-z]\")", &result.mSeed, &result.mStartScore, &result.mScore, &result.mEpochs, &result.mSeconds, termination);
+    if (fields < 5)
+    {
+        return std::nullopt;
+    }
+
+    for (auto candidate : {Termination::Converged, Termination::Budget, Termination::Plateau, Termination::TimeLimit, Termination::Polished, Termination::Gated, Termination::Jammed})
+    {
+        if (std::string(termination) == TerminationName(candidate))
+        {
+            result.mTermination = candidate;
+        }
+    }
+
+    return result;
+}
+
+// One line summary so engines and settings can be compared on the same seed range
+inline void PrintSummary(std::vector<WorkResult> results, std::ostream & out)
+{
+    if (results.empty())
+    {
+        out << "No results" << std::endl;
+        return;
+    }
+
+    size_t successes = 0;
+    size_t abandoned = 0;
+    double cpuSeconds = 0;
+    for (auto const & result : results)
+    {
+        successes += result.mScore == 0;
+        abandoned += result.mTermination == Termination::Plateau || result.mTermination == Termination::TimeLimit || result.mTermination == Termination::Gated
+            || result.mTermination == Termination::Jammed;
+        cpuSeconds += result.mSeconds;
+    }
+
+    auto middle = results.begin() + results.size() / 2;
+    std::nth_element(results.begin(), middle, results.end(), [](auto const & a, auto const & b) { return a.mEpochs < b.mEpochs; });
+
+    out << "seeds=" << results.size()
+        << " successes=" << successes
+        << " abandoned=" << abandoned
+        << " median_epochs=" << middle->mEpochs
+        << " cpu_seconds=" << cpuSeconds
+        << " successes_per_cpu_second=" << (cpuSeconds > 0 ? successes / cpuSeconds : 0)
+        << std::endl;
+}